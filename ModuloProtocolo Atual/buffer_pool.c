@@ -0,0 +1,129 @@
+#include "buffer_pool.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Tamanho e quantidade de buffers de cada classe (~1.7 MB no total).
+// A classe de 512 KB cobre o maior pacote legal (PROTOCOL_MAX_MSG_LEN = 400000).
+static const uint32_t class_sizes[POOL_CLASS_COUNT]  = { 1024, 16 * 1024, 128 * 1024, 512 * 1024 };
+static const uint32_t class_counts[POOL_CLASS_COUNT] = { 32, 8, 4, 2 };
+
+static struct {
+    int initialized;
+    OsLock lock;  // Buffers obtidos numa thread podem ser devolvidos noutra
+    uint8_t *slab[POOL_CLASS_COUNT];        // Uma única alocação por classe
+    PoolBuffer *headers[POOL_CLASS_COUNT];  // Descritores dos buffers de cada slab
+    PoolBuffer *free_list[POOL_CLASS_COUNT];
+    PoolStats stats;
+} pool;
+
+static void pool_free_slabs(void) {
+    for (int c = 0; c < POOL_CLASS_COUNT; c++) {
+        free(pool.slab[c]);
+        free(pool.headers[c]);
+    }
+    memset(&pool, 0, sizeof(pool));
+}
+
+int pool_init(void) {
+    if (pool.initialized) return 1;
+    memset(&pool, 0, sizeof(pool));
+
+    for (int c = 0; c < POOL_CLASS_COUNT; c++) {
+        pool.slab[c] = (uint8_t*)malloc((size_t)class_sizes[c] * class_counts[c]);
+        pool.headers[c] = (PoolBuffer*)calloc(class_counts[c], sizeof(PoolBuffer));
+        if (pool.slab[c] == NULL || pool.headers[c] == NULL) {
+            pool_free_slabs();
+            return 0;
+        }
+
+        // Parte o slab em buffers e mete-os todos na lista de livres
+        for (uint32_t i = 0; i < class_counts[c]; i++) {
+            PoolBuffer *b = &pool.headers[c][i];
+            b->data = pool.slab[c] + (size_t)i * class_sizes[c];
+            b->capacity = class_sizes[c];
+            b->size_class = c;
+            b->next = pool.free_list[c];
+            pool.free_list[c] = b;
+        }
+        pool.stats.class_size[c] = class_sizes[c];
+        pool.stats.class_free[c] = class_counts[c];
+    }
+
+    os_lock_init(&pool.lock);
+    pool.initialized = 1;
+    return 1;
+}
+
+// Só pode ser chamada quando já ninguém usa buffers do pool
+void pool_destroy(void) {
+    if (!pool.initialized) return;
+    os_lock_destroy(&pool.lock);
+    pool_free_slabs();
+}
+
+PoolBuffer *pool_acquire(uint32_t size) {
+    PoolBuffer *b = NULL;
+
+    if (pool.initialized) {
+        os_lock(&pool.lock);
+        // Menor classe que serve; se estiver esgotada, tenta as maiores
+        for (int c = 0; c < POOL_CLASS_COUNT && b == NULL; c++) {
+            if (class_sizes[c] < size || pool.free_list[c] == NULL) continue;
+            b = pool.free_list[c];
+            pool.free_list[c] = b->next;
+            pool.stats.class_free[c]--;
+            pool.stats.hits[c]++;
+        }
+        if (b == NULL) pool.stats.misses++;
+        pool.stats.in_use++;
+        if (pool.stats.in_use > pool.stats.in_use_peak) pool.stats.in_use_peak = pool.stats.in_use;
+        os_unlock(&pool.lock);
+    }
+    if (b != NULL) {
+        b->next = NULL;
+        return b;
+    }
+
+    // Recurso: pool esgotado (ou por inicializar). Descritor e dados num só malloc.
+    b = (PoolBuffer*)malloc(sizeof(PoolBuffer) + size);
+    if (b == NULL) {
+        if (pool.initialized) {
+            os_lock(&pool.lock);
+            pool.stats.in_use--;
+            os_unlock(&pool.lock);
+        }
+        return NULL;
+    }
+    b->next = NULL;
+    b->data = (uint8_t*)(b + 1);
+    b->capacity = size;
+    b->size_class = -1;
+    return b;
+}
+
+void pool_release(PoolBuffer *buf) {
+    if (buf == NULL) return;
+
+    if (pool.initialized) {
+        os_lock(&pool.lock);
+        if (buf->size_class >= 0) {
+            buf->next = pool.free_list[buf->size_class];
+            pool.free_list[buf->size_class] = buf;
+            pool.stats.class_free[buf->size_class]++;
+        }
+        pool.stats.in_use--;
+        os_unlock(&pool.lock);
+    }
+    if (buf->size_class < 0) free(buf);
+}
+
+void pool_get_stats(PoolStats *out) {
+    if (!pool.initialized) {
+        memset(out, 0, sizeof(PoolStats));
+        return;
+    }
+    os_lock(&pool.lock);
+    *out = pool.stats;
+    os_unlock(&pool.lock);
+}
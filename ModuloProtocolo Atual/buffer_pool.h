@@ -0,0 +1,37 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdint.h>
+
+// --- POOL DE BUFFERS POR CLASSES DE TAMANHO ---
+// Buffers pré-alocados (1 KB / 16 KB / 128 KB / 512 KB) onde a receção monta os
+// pacotes. Evita um malloc por pacote e os arrays estáticos gigantes.
+#define POOL_CLASS_COUNT 4
+
+typedef struct PoolBuffer {
+    struct PoolBuffer *next;   // Ligação na lista de livres da classe
+    uint8_t *data;             // Memória utilizável
+    uint32_t capacity;         // Tamanho da memória utilizável
+    int size_class;            // Classe de origem (-1 = malloc de recurso, fora do pool)
+} PoolBuffer;
+
+typedef struct {
+    uint32_t class_size[POOL_CLASS_COUNT];   // Tamanho dos buffers de cada classe
+    uint32_t class_free[POOL_CLASS_COUNT];   // Buffers livres neste momento
+    uint32_t hits[POOL_CLASS_COUNT];         // Pedidos servidos por esta classe
+    uint32_t misses;                         // Pedidos sem buffer livre (caíram no malloc)
+    uint32_t in_use;                         // Buffers entregues e ainda não devolvidos
+    uint32_t in_use_peak;                    // Máximo de buffers em uso ao mesmo tempo
+} PoolStats;
+
+// Reserva todos os slabs de uma vez (chamar no arranque, antes das threads)
+int pool_init(void);
+void pool_destroy(void);
+
+// Devolve um buffer com pelo menos 'size' bytes, ou NULL se não houver memória
+PoolBuffer *pool_acquire(uint32_t size);
+void pool_release(PoolBuffer *buf);
+
+void pool_get_stats(PoolStats *out);
+
+#endif // BUFFER_POOL_H
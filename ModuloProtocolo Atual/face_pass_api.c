@@ -1,35 +1,209 @@
 #include "face_pass_api.h"
 #include "protocol_msg.h"
 #include <stdio.h>
+#include <string.h>
 
-void FacePass_InitModule(HANDLE hSerial, uint16_t *seq) {
-    protocol_send_msg(hSerial, "/api/module/init", "{}", (*seq)++);
+#define URI_INIT_MODULE   "/api/module/init"
+#define URI_CREATE_GROUP  "/api/book/create/group/face"
+#define URI_FACE_REPEAT   "/api/set/face_repeat"
+#define URI_DELETE_USERS  "/api/book/del/user"
+#define BODY_DELETE_ALL   "{\"group_id\": 0, \"face_id\": 0, \"del_flag\": 2}"
+
+// Comando sem espera pela resposta, na faixa CONTROL (o BODY é copiado pela fila)
+static void send_control(TxQueue *q, const char *uri, const char *body, uint16_t *seq) {
+    tx_queue_send(q, TX_LANE_CONTROL, uri, (const uint8_t*)body, (uint32_t)strlen(body), (*seq)++, NULL, NULL);
+}
+
+void FacePass_InitModule(TxQueue *q, uint16_t *seq) {
+    send_control(q, URI_INIT_MODULE, "{}", seq);
 }
 
-void FacePass_CreateFaceGroup(HANDLE hSerial, uint16_t *seq) {
-    protocol_send_msg(hSerial, "/api/book/create/group/face", "{}", (*seq)++);
+void FacePass_CreateFaceGroup(TxQueue *q, uint16_t *seq) {
+    send_control(q, URI_CREATE_GROUP, "{}", seq);
 }
 
-void FacePass_SetDeduplication(HANDLE hSerial, int state, uint16_t *seq) {
+void FacePass_SetDeduplication(TxQueue *q, int state, uint16_t *seq) {
     char json_body[50];
     sprintf(json_body, "{\"repeat_st\": %d}", state);
-    protocol_send_msg(hSerial, "/api/set/face_repeat", json_body, (*seq)++);
+    send_control(q, URI_FACE_REPEAT, json_body, seq);
 }
 
-void FacePass_StartEnroll(HANDLE hSerial, int face_id, int timeout_ms, uint16_t *seq) {
+void FacePass_StartEnroll(TxQueue *q, int face_id, int timeout_ms, uint16_t *seq) {
     char json_body[100];
     sprintf(json_body, "{\"face_id\": %d, \"obj_type\": 0, \"time\": %d}", face_id, timeout_ms);
-    protocol_send_msg(hSerial, "/api/enroll/frm", json_body, (*seq)++);
+    send_control(q, "/api/enroll/frm", json_body, seq);
+}
+
+void FacePass_StartRecog(TxQueue *q, uint16_t *seq) {
+    send_control(q, "/api/module/start/recog", "{}", seq);
+}
+
+void FacePass_Pause(TxQueue *q, uint16_t *seq) {
+    send_control(q, "/api/module/pause", "{}", seq);
+}
+
+void FacePass_DeleteAll(TxQueue *q, uint16_t *seq) {
+    send_control(q, URI_DELETE_USERS, BODY_DELETE_ALL, seq);
 }
 
-void FacePass_StartRecog(HANDLE hSerial, uint16_t *seq) {
-    protocol_send_msg(hSerial, "/api/module/start/recog", "{}", (*seq)++);
+// --- VERSÕES COM ESPERA PELA RESPOSTA ---
+
+int FacePass_InitModuleReq(TxQueue *q, RequestTable *t, uint16_t *seq,
+                           uint32_t timeout_ms, RequestCallback cb, void *user) {
+    return request_send_queued(t, q, TX_LANE_CONTROL, URI_INIT_MODULE, "{}", (*seq)++, timeout_ms, cb, user);
+}
+
+int FacePass_CreateFaceGroupReq(TxQueue *q, RequestTable *t, uint16_t *seq,
+                                uint32_t timeout_ms, RequestCallback cb, void *user) {
+    return request_send_queued(t, q, TX_LANE_CONTROL, URI_CREATE_GROUP, "{}", (*seq)++, timeout_ms, cb, user);
 }
 
-void FacePass_Pause(HANDLE hSerial, uint16_t *seq) {
-    protocol_send_msg(hSerial, "/api/module/pause", "{}", (*seq)++);
+int FacePass_SetDeduplicationReq(TxQueue *q, RequestTable *t, int state, uint16_t *seq,
+                                 uint32_t timeout_ms, RequestCallback cb, void *user) {
+    char json_body[50];
+    sprintf(json_body, "{\"repeat_st\": %d}", state);
+    return request_send_queued(t, q, TX_LANE_CONTROL, URI_FACE_REPEAT, json_body, (*seq)++, timeout_ms, cb, user);
 }
 
-void FacePass_DeleteAll(HANDLE hSerial, uint16_t *seq) {
-    protocol_send_msg(hSerial, "/api/book/del/user", "{\"group_id\": 0, \"face_id\": 0, \"del_flag\": 2}", (*seq)++);
+int FacePass_DeleteAllReq(TxQueue *q, RequestTable *t, uint16_t *seq,
+                          uint32_t timeout_ms, RequestCallback cb, void *user) {
+    return request_send_queued(t, q, TX_LANE_CONTROL, URI_DELETE_USERS, BODY_DELETE_ALL, (*seq)++,
+                               timeout_ms, cb, user);
+}
+
+// --- ARRANQUE DO MÓDULO ---
+
+static void bringup_step_cb(uint16_t serial, RequestStatus status, ParsedPacket *resp, void *user);
+
+// Envia (ou reenvia) o passo atual com o prazo atual
+static void bringup_send_step(FacePassBringup *b) {
+    int sent = -1;
+    uint16_t serial = *b->seq; // Os FacePass_*Req usam (*seq)++
+    switch (b->state) {
+    case BRINGUP_INIT_MODULE:
+        sent = FacePass_InitModuleReq(b->txq, b->requests, b->seq, b->timeout_ms, bringup_step_cb, b);
+        break;
+    case BRINGUP_CREATE_GROUP:
+        sent = FacePass_CreateFaceGroupReq(b->txq, b->requests, b->seq, b->timeout_ms, bringup_step_cb, b);
+        break;
+    case BRINGUP_SET_DEDUP:
+        sent = FacePass_SetDeduplicationReq(b->txq, b->requests, b->dedup_state, b->seq,
+                                            b->timeout_ms, bringup_step_cb, b);
+        break;
+    default:
+        return;
+    }
+    if (sent < 0) {
+        // Nem chegou à fila (fila parada ou tabela cheia): não há resposta a esperar
+        b->failed_step = b->state;
+        b->state = BRINGUP_FAILED;
+        b->total_ms = os_now_ms() - b->start_ms;
+        return;
+    }
+    b->serial = serial;
+}
+
+// Deixa de esperar pela tentativa anterior do passo (o seu REQ_CANCELLED é ignorado)
+static void bringup_cancel_prev(FacePassBringup *b) {
+    if (!b->has_prev) return;
+    b->has_prev = 0;
+    request_table_cancel(b->requests, b->prev_serial);
+}
+
+static void bringup_enter_step(FacePassBringup *b, BringupState next) {
+    b->state = next;
+    b->has_prev = 0;
+    b->attempt = 1;
+    b->timeout_ms = BRINGUP_FIRST_TIMEOUT_MS;
+    if (next == BRINGUP_READY) b->total_ms = os_now_ms() - b->start_ms;
+    else bringup_send_step(b);
+}
+
+static void bringup_step_cb(uint16_t serial, RequestStatus status, ParsedPacket *resp, void *user) {
+    FacePassBringup *b = (FacePassBringup*)user;
+    int step = (int)b->state - BRINGUP_INIT_MODULE;
+
+    int is_prev = b->has_prev && serial == b->prev_serial;
+    if (step < 0 || step >= BRINGUP_STEPS || (serial != b->serial && !is_prev)) {
+        // Já terminou (ex.: cancelado ao fechar) ou é de uma tentativa esquecida
+        if (resp) protocol_packet_release(resp);
+        return;
+    }
+    if (is_prev && status != REQ_OK) { // A tentativa anterior não respondeu mesmo
+        b->has_prev = 0;
+        return;
+    }
+    b->step_ms[step] = os_now_ms() - b->start_ms;
+    for (int i = 0; i < step; i++) b->step_ms[step] -= b->step_ms[i];
+
+    if (status == REQ_OK) {
+        // Resposta a uma das duas tentativas: a outra deixa de interessar
+        int other_pending = b->has_prev;
+        uint16_t other = is_prev ? b->serial : b->prev_serial;
+        if (!protocol_json_find_int(resp->body, resp->body_len, "err_info", &b->step_err[step])) {
+            b->step_err[step] = -1;
+        }
+        protocol_packet_release(resp);
+        // Um err_info != 0 (ex.: grupo já existente) não impede os passos seguintes
+        bringup_enter_step(b, (BringupState)(b->state + 1));
+        // Só depois de avançar: o REQ_CANCELLED da outra já não é do passo atual
+        if (other_pending) request_table_cancel(b->requests, other);
+    } else if (status == REQ_TIMEOUT && b->attempt < BRINGUP_MAX_ATTEMPTS) {
+        // Módulo ocupado ou resposta perdida: repete com o dobro do prazo. A
+        // tentativa que expirou continua à espera com o mesmo prazo novo: se a
+        // resposta dela chegar primeiro, serve na mesma.
+        uint16_t expired = b->serial;
+        b->attempt++;
+        b->retries++;
+        b->timeout_ms *= 2;
+        bringup_cancel_prev(b);
+        bringup_send_step(b);
+        if (b->state != BRINGUP_FAILED &&
+            request_table_watch(b->requests, expired, b->timeout_ms, bringup_step_cb, b) == 0) {
+            b->prev_serial = expired;
+            b->has_prev = 1;
+        }
+    } else {
+        b->failed_step = b->state;
+        b->state = BRINGUP_FAILED;
+        b->total_ms = os_now_ms() - b->start_ms;
+        bringup_cancel_prev(b);
+    }
+}
+
+void FacePass_BringupStart(FacePassBringup *b, TxQueue *q, RequestTable *t,
+                           uint16_t *seq, int dedup_state) {
+    memset(b, 0, sizeof(*b));
+    b->txq = q;
+    b->requests = t;
+    b->seq = seq;
+    b->dedup_state = dedup_state;
+    for (int i = 0; i < BRINGUP_STEPS; i++) b->step_err[i] = -1;
+    b->start_ms = os_now_ms();
+    bringup_enter_step(b, BRINGUP_INIT_MODULE);
+}
+
+int FacePass_BringupDone(const FacePassBringup *b) {
+    return b->state == BRINGUP_READY || b->state == BRINGUP_FAILED;
+}
+
+// --- REENVIO DE FEATURES ---
+
+int FacePass_UploadFeature(TxQueue *q, const char *uri, int face_id, const uint8_t *feature, uint32_t feature_len,
+                           uint16_t *seq, TxDoneCallback done, void *user) {
+    char prefix[48];
+    int prefix_len = sprintf(prefix, "{\"face_id\": %d, \"ft\": \"", face_id);
+    size_t b64_len = base64_encoded_length(feature_len);
+    size_t body_len = (size_t)prefix_len + b64_len + 2; // + "}
+    if (body_len > PROTOCOL_MAX_MSG_LEN) return 0;
+
+    // O Base64 é escrito direto no BODY do pacote: nem malloc nem cópia intermédia
+    PoolBuffer *body = pool_acquire((uint32_t)body_len);
+    if (body == NULL) return 0;
+    char *dst = (char*)body->data;
+    memcpy(dst, prefix, (size_t)prefix_len);
+    base64_encode_into(feature, feature_len, dst + prefix_len, b64_len);
+    memcpy(dst + prefix_len + b64_len, "\"}", 2);
+
+    return tx_queue_send_pooled(q, TX_LANE_BULK, uri, body, (uint32_t)body_len, (*seq)++, done, user);
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #ifndef FACE_PASS_API_H
 #define FACE_PASS_API_H
 
-#include <windows.h>
+#include "serial_transport.h"
+#include "request_table.h"
+#include "tx_queue.h"
 #include <stdint.h>
 
 // Estrutura para o cabeçalho do ficheiro .bin guardado localmente
@@ -12,25 +14,97 @@ typedef struct {
 } UserHeader;
 #pragma pack(pop)
 
+// --- COMANDOS ---
+// Todos saem pela fila de envio da porta (tx_queue.h), nunca direto na porta:
+// várias threads podem mandar comandos sem misturar pacotes, e os comandos vão
+// na faixa CONTROL, à frente de um envio BULK (features) que esteja a decorrer.
+// Voltam assim que o pacote fica na fila.
+
 // Inicializa o módulo
-void FacePass_InitModule(HANDLE hSerial, uint16_t *seq);
+void FacePass_InitModule(TxQueue *q, uint16_t *seq);
 
 // Cria o grupo de faces base
-void FacePass_CreateFaceGroup(HANDLE hSerial, uint16_t *seq);
+void FacePass_CreateFaceGroup(TxQueue *q, uint16_t *seq);
 
 // Configura a verificação de duplicidade (1 para ativar, 0 para desativar)
-void FacePass_SetDeduplication(HANDLE hSerial, int state, uint16_t *seq);
+void FacePass_SetDeduplication(TxQueue *q, int state, uint16_t *seq);
 
 // Inicia o processo de registo (cadastro) de uma nova face
-void FacePass_StartEnroll(HANDLE hSerial, int face_id, int timeout_ms, uint16_t *seq);
+void FacePass_StartEnroll(TxQueue *q, int face_id, int timeout_ms, uint16_t *seq);
 
 // Inicia o modo de reconhecimento contínuo
-void FacePass_StartRecog(HANDLE hSerial, uint16_t *seq);
+void FacePass_StartRecog(TxQueue *q, uint16_t *seq);
 
 // Pausa o reconhecimento
-void FacePass_Pause(HANDLE hSerial, uint16_t *seq);
+void FacePass_Pause(TxQueue *q, uint16_t *seq);
 
 // Apaga todas as faces guardadas no módulo
-void FacePass_DeleteAll(HANDLE hSerial, uint16_t *seq);
+void FacePass_DeleteAll(TxQueue *q, uint16_t *seq);
+
+// --- VERSÕES COM ESPERA PELA RESPOSTA (request_table.h) ---
+// Registam o pedido em 't' e voltam logo; 'cb' é chamado quando chegar a resposta
+// com o mesmo serial ou ao fim de 'timeout_ms'. Devolvem -1 se não foi enviado.
+int FacePass_InitModuleReq(TxQueue *q, RequestTable *t, uint16_t *seq,
+                           uint32_t timeout_ms, RequestCallback cb, void *user);
+int FacePass_CreateFaceGroupReq(TxQueue *q, RequestTable *t, uint16_t *seq,
+                                uint32_t timeout_ms, RequestCallback cb, void *user);
+int FacePass_SetDeduplicationReq(TxQueue *q, RequestTable *t, int state, uint16_t *seq,
+                                 uint32_t timeout_ms, RequestCallback cb, void *user);
+int FacePass_DeleteAllReq(TxQueue *q, RequestTable *t, uint16_t *seq,
+                          uint32_t timeout_ms, RequestCallback cb, void *user);
+
+// --- REENVIO DE FEATURES (re-provisionamento a partir dos face_*.bin) ---
+// Monta {"face_id": N, "ft": "<Base64>"} num buffer do pool, com o Base64 escrito
+// no próprio BODY, e põe-no na faixa BULK de 'q'. A rota de registo de features
+// depende do firmware do módulo, por isso vem do chamador. Devolve 0 se recusado.
+int FacePass_UploadFeature(TxQueue *q, const char *uri, int face_id, const uint8_t *feature, uint32_t feature_len,
+                           uint16_t *seq, TxDoneCallback done, void *user);
+
+// --- ARRANQUE DO MÓDULO (máquina de estados guiada pelas respostas) ---
+// init -> criar grupo -> deduplicação, um passo de cada vez: cada passo só é
+// enviado depois da resposta ao anterior. Sem resposta dentro do prazo, o passo
+// é repetido (com serial novo) e o prazo dobra, até BRINGUP_MAX_ATTEMPTS.
+// O /api/module/init não é idempotente: o primeiro prazo é largo (o Sleep fixo
+// antigo era de 330 ms) e, depois de repetir, uma resposta atrasada ao serial
+// anterior do mesmo passo também conta.
+#define BRINGUP_FIRST_TIMEOUT_MS 1000
+#define BRINGUP_MAX_ATTEMPTS     3     // 1000 + 2000 + 4000 ms no pior caso
+
+typedef enum {
+    BRINGUP_IDLE = 0,
+    BRINGUP_INIT_MODULE,
+    BRINGUP_CREATE_GROUP,
+    BRINGUP_SET_DEDUP,
+    BRINGUP_READY,
+    BRINGUP_FAILED      // Um passo esgotou as tentativas
+} BringupState;
+
+#define BRINGUP_STEPS 3
+
+typedef struct {
+    BringupState state;
+    BringupState failed_step;       // Passo que falhou (só com BRINGUP_FAILED)
+    TxQueue *txq;
+    RequestTable *requests;
+    uint16_t *seq;
+    int dedup_state;
+    int attempt;                    // Tentativa atual do passo (1..BRINGUP_MAX_ATTEMPTS)
+    uint16_t serial;                // Serial da tentativa atual
+    uint16_t prev_serial;           // Serial da tentativa anterior do mesmo passo...
+    int has_prev;                   // ...que ainda está à espera de resposta atrasada
+    uint32_t timeout_ms;            // Prazo da tentativa atual
+    uint32_t start_ms;
+    uint32_t total_ms;              // Tempo até READY (ou até FAILED)
+    uint32_t step_ms[BRINGUP_STEPS];   // Tempo de cada passo, repetições incluídas
+    int step_err[BRINGUP_STEPS];       // err_info da resposta (-1 se não veio)
+    int retries;                    // Repetições por timeout, em todos os passos
+} FacePassBringup;
+
+// Envia o primeiro passo; o resto avança sozinho a partir dos callbacks da
+// tabela (request_table_complete / request_table_poll no ciclo de receção)
+void FacePass_BringupStart(FacePassBringup *b, TxQueue *q, RequestTable *t,
+                           uint16_t *seq, int dedup_state);
+// 1 quando chegou a READY ou FAILED
+int FacePass_BringupDone(const FacePassBringup *b);
 
 #endif // FACE_PASS_API_H
\ No newline at end of file
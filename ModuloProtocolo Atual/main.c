@@ -9,67 +9,394 @@
 #include "serial_transport.h"
 #include "protocol_msg.h"
 #include "face_pass_api.h"
+#include "request_table.h"
+#include "tx_queue.h"
 #include "cJSON.h"
 
 // --- CONFIGURAÇÕES ---
 #define SERIAL_PORT "COM14" 
 #define BAUD_RATE 115200
 #define TIMEOUT_MS 20000 
+#define CMD_TIMEOUT_MS 1000 // Prazo da resposta aos comandos simples (init, grupo, apagar...)
+
+// 1 = mede o tempo entre a chegada dos últimos bytes de um pacote e a entrega
+// ao callback, e imprime o histograma à saída
+#ifndef RX_LATENCY_HISTOGRAM
+#define RX_LATENCY_HISTOGRAM 0
+#endif
+
+// 1 = depois do arranque envia rajadas de 1000 comandos /api/set/face_repeat
+// (sem e com agrupamento na fila de envio) e imprime as chamadas ao SO de cada uma
+#ifndef TX_COALESCE_BENCHMARK
+#define TX_COALESCE_BENCHMARK 0
+#endif
 
 // --- VARIÁVEIS GLOBAIS PARTILHADAS (FIFO) ---
-#define RB_CAPACITY 200000 // 200KB (Espaço seguro para fotos grandes em Base64)
-uint8_t rb_memory[RB_CAPACITY];
+#define RB_CAPACITY (512 * 1024) // 512KB: o decoder deixa o pacote em curso no FIFO até estar completo
+
+#if RB_CAPACITY < PROTOCOL_MAX_MSG_LEN
+#error "O FIFO tem de conseguir guardar o maior pacote (PROTOCOL_MAX_MSG_LEN)"
+#endif
+uint8_t rb_memory[RB_CAPACITY]; // Só usado se o SO recusar o FIFO espelhado
 RingBuffer rx_fifo;
 
-// O "Cadeado" para proteger o buffer entre a thread de leitura e o programa principal
-CRITICAL_SECTION buffer_lock; 
+// O FIFO não precisa de cadeado: a thread de leitura é o único produtor e o
+// main.c o único consumidor (ver RingBuffer em protocol_msg.h)
+
+// --- DESCODIFICADOR DE PACOTES (Camada 2) ---
+// Guarda o estado entre chamadas: cada byte do FIFO é lido uma única vez.
+// Cada pacote é montado num buffer do pool (buffer_pool.h), de qualquer tamanho legal.
+ProtocolDecoder rx_decoder;
+
+// --- PEDIDOS À ESPERA DE RESPOSTA (correlação pelo serial) ---
+RequestTable requests;
+
+// --- FILA DE ENVIO DA PORTA (tx_queue.h) ---
+// Todos os comandos FacePass_* passam por aqui: CONTROL para comandos e
+// configuração, BULK para reenvio de features
+TxQueue tx_queue;
+
+// --- ESTADO DAS SESSÕES (preenchido pelos callbacks do decoder) ---
+typedef struct {
+    int face_id;         // ID a atribuir à face capturada
+    int success;
+    int fail_duplicate;
+    int should_break;    // Falha grave (ex.: ausência de rosto): parar de esperar
+    int empty_ft;        // Respostas com 'ft' vazio ou "null" recebidas até agora
+} EnrollSession;
+
+typedef struct {
+    int id_found_flag;
+} RecogSession;
+
+EnrollSession enroll;
+RecogSession recog;
+
+// --- HISTOGRAMA DE LATÊNCIA DA RECEÇÃO ---
+#if RX_LATENCY_HISTOGRAM
+#define LAT_BUCKETS 9
+static const double lat_limits_us[LAT_BUCKETS - 1] = { 100, 250, 500, 1000, 2000, 5000, 10000, 20000 };
+static uint32_t lat_counts[LAT_BUCKETS];
+static volatile LONGLONG rx_arrival_ticks; // Escrito pela thread de leitura
+static LARGE_INTEGER qpc_freq;
+
+static void lat_record(LONGLONG arrival) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    double us = (double)(now.QuadPart - arrival) * 1e6 / (double)qpc_freq.QuadPart;
+    int b = 0;
+    while (b < LAT_BUCKETS - 1 && us >= lat_limits_us[b]) b++;
+    lat_counts[b]++;
+}
+
+static void lat_print(void) {
+    printf("\nLatencia chegada -> callback:\n");
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        if (b < LAT_BUCKETS - 1) printf("  < %6.0f us: %u\n", lat_limits_us[b], lat_counts[b]);
+        else printf("  >=%6.0f us: %u\n", lat_limits_us[b - 1], lat_counts[b]);
+    }
+}
+#endif
 
 // --- FUNÇÃO CALLBACK (Chamada pela Thread da Camada 1) ---
 // Executada em PANO DE FUNDO sempre que o módulo envia bytes
-void on_serial_data_received(const uint8_t *data, uint32_t length) {
-    // TRANCA O CADEADO: O main.c não pode ler o buffer enquanto escrevemos nele
-    EnterCriticalSection(&buffer_lock); 
+void on_serial_data_received(const uint8_t *data, uint32_t length, void *user) {
+    // Injeta os dados novos na "cabeça" do Buffer Circular (user = &rx_fifo).
+    // Nunca bloqueia: se o FIFO estiver cheio, os bytes são contados em dropped.
+    rb_put((RingBuffer*)user, data, length);
+#if RX_LATENCY_HISTOGRAM
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    rx_arrival_ticks = now.QuadPart;
+#endif
+}
+
+// Passa para o decoder os bytes novos do FIFO, lidos diretamente dos (no máximo
+// dois) pedaços do buffer circular: nada é achatado nem re-lido entre polls.
+static void pump_rx_fifo(void) {
+    RxSpan span;
+#if RX_LATENCY_HISTOGRAM
+    LONGLONG arrival = rx_arrival_ticks; // Lido antes do FIFO: nunca é mais recente que os bytes
+    uint32_t frames_before = rx_decoder.frames_ok;
+#endif
+    if (rb_peek_span(&rx_fifo, &span) == 0) return;
+
+    size_t used = protocol_decoder_feed_span(&rx_decoder, &span);
+    rb_consume(&rx_fifo, (int)used);
+#if RX_LATENCY_HISTOGRAM
+    if (rx_decoder.frames_ok != frames_before) lat_record(arrival);
+#endif
+}
+
+// O handle da consola fica assinalado enquanto houver QUALQUER registo por ler:
+// a tecla largada que o _getch() deixa, foco, rato, redimensionar... O _kbhit()
+// salta-os sem os tirar, e o Wait seguinte voltaria logo (ciclo a 100% de CPU).
+// Tira-os até ao primeiro carácter premido, que fica para o _kbhit()/_getch().
+static void console_drop_idle_records(HANDLE hInput) {
+    INPUT_RECORD rec;
+    DWORD n;
+    while (!_kbhit() && PeekConsoleInputA(hInput, &rec, 1, &n) && n == 1) {
+        if (rec.EventType == KEY_EVENT && rec.Event.KeyEvent.bKeyDown && rec.Event.KeyEvent.uChar.AsciiChar != 0) break;
+        ReadConsoleInputA(hInput, &rec, 1, &n);
+    }
+}
+
+// Bloqueia até chegarem bytes da serial, haver uma tecla ou passar 'timeout_ms'
+// (INFINITE = sem prazo). Sem bytes nem teclas, a thread não acorda.
+static void wait_rx_or_key(SerialHandle hSerial, DWORD timeout_ms) {
+    HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+    HANDLE handles[2] = { serial_rx_event(hSerial), hInput };
+    if (WaitForMultipleObjects(2, handles, FALSE, timeout_ms) == WAIT_OBJECT_0 + 1) {
+        console_drop_idle_records(hInput);
+    }
+}
+
+// --- CALLBACK DO DECODER: COMANDOS (arranque, apagar) ---
+// Só interessam as respostas aos pedidos em voo; o resto é descartado
+static void on_control_packet(ParsedPacket *pkt, void *user) {
+    (void)user;
+    if (!request_table_complete(&requests, pkt)) protocol_packet_release(pkt);
+}
+
+// Bombeia o FIFO até todos os pedidos em voo terem resposta ou prazo esgotado.
+// Dorme no evento da serial, nunca mais do que até ao próximo prazo.
+static void wait_requests(SerialHandle hSerial) {
+    while (request_table_pending(&requests) > 0) {
+        pump_rx_fifo();
+        request_table_poll(&requests);
+        if (request_table_pending(&requests) == 0) break;
+        serial_wait_rx(hSerial, request_table_next_deadline(&requests));
+    }
+}
+
+static void report_request(const char *name, const RequestFuture *f) {
+    if (f->status == REQ_TIMEOUT) printf("[AVISO] %s: sem resposta\n", name);
+    else if (f->status == REQ_OK && f->err > 0) printf("[AVISO] %s: err_info=%d\n", name, f->err);
+}
+
+// Grava face_<id>.bin descodificando o 'ft' direto do corpo do pacote para o
+// ficheiro, uma janela de cada vez: nem cópia da string nem buffer do resultado
+static int save_feature_file(int face_id, const char *ft, size_t ft_len) {
+    char filename[50];
+    sprintf(filename, "face_%d.bin", face_id);
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) return 0;
+
+    UserHeader header;
+    header.face_id = face_id;
+    header.feature_len = (uint16_t)base64_decoded_length(ft, ft_len);
+    fwrite(&header, sizeof(UserHeader), 1, fp);
+
+    Base64Stream stream;
+    base64_stream_init(&stream, base64_sink_file, fp);
+    int ok = base64_stream_feed(&stream, ft, ft_len) && base64_stream_finish(&stream);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        remove(filename); // Não deixa um ficheiro de features truncado
+        printf("-> Base64 invalido no 'ft'\n");
+        return 0;
+    }
+    printf("-> Arquivo Salvo: %s\n", filename);
+    return 1;
+}
+
+// --- CALLBACK DO DECODER: MODO CADASTRO ---
+// Chamado para cada pacote matematicamente perfeito durante o cadastro
+static void on_enroll_packet(ParsedPacket *pkt, void *user) {
+    EnrollSession *s = (EnrollSession*)user;
+    if (request_table_complete(&requests, pkt)) return; // Resposta a um comando pendente
+    if (s->success || s->fail_duplicate || s->should_break) { // Sessão já terminou
+        protocol_packet_release(pkt);
+        return;
+    }
+
+    // Os campos são lidos direto do corpo em bruto: o 'ft' (~80 KB) não é copiado
+    // para uma árvore cJSON; o buffer do pacote só volta ao pool no fim
+    int err_val = -1, id_exist = 0;
+    const char *ft = NULL;
+    size_t ft_len = 0;
+    protocol_json_find_int(pkt->body, pkt->body_len, "err_info", &err_val);
+    protocol_json_find_int(pkt->body, pkt->body_len, "id_existed", &id_exist);
+    int has_ft = protocol_json_find_string(pkt->body, pkt->body_len, "ft", &ft, &ft_len);
     
-    // Injeta os dados novos na "cabeça" do Buffer Circular
-    rb_put(&rx_fifo, data, length);
+    // 1. Tratamento de Erros enviados pelo módulo
+    if (err_val > 0) {
+        if (id_exist == 1 || err_val == 36) { 
+            printf("\n[ERRO: FACE DUPLICADA]\n"); 
+            s->fail_duplicate = 1; 
+        } else {
+            // Se for erro de Timeout (ex: 13) ou outro sem ser duplicado
+            printf("\n[ERRO]\n");
+            s->should_break = 1; 
+        }
+    }
+
+    // 2. Se não há erro e existe a string Base64 ('ft')
+    else if (err_val == 0 && has_ft) {
+        // --- A NOVA PROTEÇÃO ---
+        // Ignora se o módulo enviar a palavra "null" ou uma string curta demais
+        if ((ft_len == 4 && memcmp(ft, "null", 4) == 0) || ft_len < 100) {
+            s->empty_ft++;
+            if (s->empty_ft == 3) s->should_break = 1;
+        } else {
+            // É um Base64 autêntico e volumoso!
+            printf("\n[SUCESSO]\n");
+            save_feature_file(s->face_id, ft, ft_len);
+            s->success = 1; 
+        }
+    }
     
-    // DESTRANCA O CADEADO
-    LeaveCriticalSection(&buffer_lock); 
+    protocol_packet_release(pkt);
+
+    // Se houve falha grave (como ausência de rosto), o contador recomeça
+    if (s->should_break) s->empty_ft = 0;
 }
 
+// --- CALLBACK DO DECODER: MODO RECONHECIMENTO ---
+static void on_recog_packet(ParsedPacket *pkt, void *user) {
+    RecogSession *s = (RecogSession*)user;
+    if (request_table_complete(&requests, pkt)) return; // Resposta a um comando pendente
+
+    // Leitura direta do corpo (sem árvore cJSON): nenhum malloc por evento
+    int id_val = 0;
+    int score_val = 0;
+    if (FacePass_ExtractEvent(pkt->body, pkt->body_len, &id_val, &score_val)) {
+        // A função mapeia o iden_info internamente
+        if (id_val > 0) {
+            printf("\n\nID Reconhecido: %d (Score: %d%%).\nAcesso Permitido.\n", id_val, score_val);
+            s->id_found_flag = 1; 
+            
+        } else if ((id_val == 0)||(protocol_uri_contains(pkt, "recog") || protocol_uri_contains(pkt, "push"))) {
+            // Rosto detectado mas não cadastrado
+            printf(".");
+        }
+    }
+    protocol_packet_release(pkt);
+}
+
+// --- BENCHMARK DO AGRUPAMENTO DE ENVIOS ---
+#if TX_COALESCE_BENCHMARK
+#define BENCH_COMMANDS 1000
+
+static void tx_coalesce_benchmark(SerialHandle hSerial, uint16_t *seq) {
+    static TxQueue q; // ~27 KB com o buffer de agrupamento e a reserva de descritores
+    // A janela só se aplica a BULK: a última rajada vai nessa faixa
+    static const struct { const char *name; uint32_t delay_ms, max_frame; TxLane lane; } modes[] = {
+        { "sem agrupamento", 0, 0, TX_LANE_CONTROL },
+        { "fila apenas", 0, TX_COALESCE_DEFAULT_MAX, TX_LANE_CONTROL },
+        { "janela 2 ms (BULK)", TX_COALESCE_BULK_MS, TX_COALESCE_DEFAULT_MAX, TX_LANE_BULK },
+    };
+    char json_body[50];
+    int len = sprintf(json_body, "{\"repeat_st\": %d}", 1); // O mesmo valor do arranque
+
+    printf("\nAgrupamento de envios (%d comandos por rajada):\n", BENCH_COMMANDS);
+    for (int m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])); m++) {
+        if (!tx_queue_start(&q, hSerial)) return;
+        tx_queue_set_coalescing(&q, modes[m].delay_ms, modes[m].max_frame);
+
+        uint32_t calls_before = serial_tx_syscalls(hSerial);
+        uint64_t t0 = os_now_us();
+        for (int i = 0; i < BENCH_COMMANDS; i++) {
+            tx_queue_send(&q, modes[m].lane, "/api/set/face_repeat",
+                          (const uint8_t*)json_body, (uint32_t)len, (*seq)++, NULL, NULL);
+        }
+
+        // As respostas vão chegando: o FIFO é esvaziado enquanto a fila sai
+        TxLaneStats st;
+        do {
+            pump_rx_fifo();
+            serial_wait_rx(hSerial, 10);
+            tx_queue_get_stats(&q, modes[m].lane, &st);
+        } while (st.depth > 0);
+        uint64_t elapsed_us = os_now_us() - t0;
+        uint32_t calls = serial_tx_syscalls(hSerial) - calls_before;
+        tx_queue_stop(&q);
+
+        printf("  %-18s: %5u chamadas ao SO por %d comandos, %6.1f ms, espera max %u us\n",
+               modes[m].name, calls, BENCH_COMMANDS, elapsed_us / 1000.0, st.wait_us_max);
+    }
+
+    // Deixa chegar as últimas respostas antes do menu
+    DWORD start = GetTickCount();
+    while (GetTickCount() - start < CMD_TIMEOUT_MS) {
+        pump_rx_fifo();
+        serial_wait_rx(hSerial, 50);
+    }
+}
+#endif
+
 int main() {
 
-    int aux=0;
+#if RX_LATENCY_HISTOGRAM
+    QueryPerformanceFrequency(&qpc_freq);
+#endif
+
+    // 1. Inicializa o Buffer Circular: de preferência espelhado (pacotes que dão
+    //    a volta ao fim do FIFO continuam contíguos); senão, o array estático
+    if (!rb_init_mirrored(&rx_fifo, RB_CAPACITY)) {
+        rb_init(&rx_fifo, rb_memory, RB_CAPACITY);
+    }
 
-    // 1. Inicializa o mecanismo de proteção (cadeado) e o Buffer Circular
-    InitializeCriticalSection(&buffer_lock); 
-    rb_init(&rx_fifo, rb_memory, RB_CAPACITY);
+    // Reserva os buffers de pacotes (receção e envio) e prepara o decoder
+    if (!pool_init()) {
+        printf("[ERRO]\n");
+        rb_destroy(&rx_fifo);
+        return 1;
+    }
+    protocol_decoder_init(&rx_decoder, on_control_packet, NULL);
+    request_table_init(&requests);
 
     // 2. Abre a porta serial (Camada 1)
-    HANDLE hSerial = serial_open(SERIAL_PORT, BAUD_RATE);
+    SerialHandle hSerial = serial_open(SERIAL_PORT, BAUD_RATE);
     if (!hSerial) { 
         printf("[ERRO]\n"); 
-        DeleteCriticalSection(&buffer_lock);
+        request_table_destroy(&requests);
+        pool_destroy();
+        rb_destroy(&rx_fifo);
         return 1; 
     }
 
     // 3. ARRANCAMOS A THREAD DE BACKGROUND AQUI:
-    if (!serial_start_rx_thread(hSerial, on_serial_data_received)) {
+    if (!serial_start_rx_thread(hSerial, on_serial_data_received, &rx_fifo)) {
         printf("[ERRO]\n");
         serial_close(hSerial);
-        DeleteCriticalSection(&buffer_lock);
+        request_table_destroy(&requests);
+        pool_destroy();
+        rb_destroy(&rx_fifo);
+        return 1;
+    }
+
+    if (!tx_queue_start(&tx_queue, hSerial)) {
+        printf("[ERRO]\n");
+        serial_close(hSerial);
+        request_table_destroy(&requests);
+        pool_destroy();
+        rb_destroy(&rx_fifo);
         return 1;
     }
 
     uint16_t seq = 0;
-    char filename[50];
     int ch;
 
-    // 4. Inicialização limpa do módulo (Camada 3)
-    FacePass_InitModule(hSerial, &seq);         Sleep(330);
-    FacePass_CreateFaceGroup(hSerial, &seq);    Sleep(330);
-    FacePass_SetDeduplication(hSerial, 1, &seq);Sleep(330); 
+    // 4. Inicialização limpa do módulo (Camada 3): cada passo espera pela sua
+    //    resposta (com repetições se o módulo estiver lento), sem pausas fixas
+    FacePassBringup bringup;
+    FacePass_BringupStart(&bringup, &tx_queue, &requests, &seq, 1);
+    wait_requests(hSerial);
+
+    if (bringup.state == BRINGUP_READY) {
+        printf("Modulo pronto em %u ms (init %u / grupo %u / dedup %u ms, %d repeticoes)\n",
+               bringup.total_ms, bringup.step_ms[0], bringup.step_ms[1], bringup.step_ms[2],
+               bringup.retries);
+    } else {
+        printf("[AVISO] O modulo nao respondeu ao arranque (passo %d)\n",
+               (int)bringup.failed_step - BRINGUP_INIT_MODULE + 1);
+    }
     
+#if TX_COALESCE_BENCHMARK
+    tx_coalesce_benchmark(hSerial, &seq);
+#endif
+
     int next_global_id = 1;
 
     // 5. Loop Principal
@@ -91,114 +418,35 @@ int main() {
             printf("\n>> Modo de Cadastro: Olhe para a camera.\n");
             
             // 1. Limpa o FIFO de forma segura antes de começar
-            EnterCriticalSection(&buffer_lock);
-            rb_init(&rx_fifo, rb_memory, RB_CAPACITY); 
-            LeaveCriticalSection(&buffer_lock);
+            rb_clear(&rx_fifo);
+
+            // Os pacotes validados passam a ser entregues ao callback do cadastro
+            enroll.face_id = next_global_id;
+            enroll.success = 0;
+            enroll.fail_duplicate = 0;
+            enroll.should_break = 0;
+            protocol_decoder_reset(&rx_decoder);
+            protocol_decoder_set_callback(&rx_decoder, on_enroll_packet, &enroll);
 
             // 2. Envia o comando para o módulo (Camada 3)
-            FacePass_StartEnroll(hSerial, next_global_id, TIMEOUT_MS, &seq);
+            FacePass_StartEnroll(&tx_queue, next_global_id, TIMEOUT_MS, &seq);
 
-            int success = 0; 
-            int fail_duplicate = 0;
             DWORD start_time = GetTickCount();
+            DWORD elapsed;
 
             // 3. Fica à espera da resposta (Timeout de segurança)
-            while ((GetTickCount() - start_time) < TIMEOUT_MS) {
+            while ((elapsed = GetTickCount() - start_time) < TIMEOUT_MS) {
                 if(_kbhit()) { _getch(); break; } // Cancela se premir uma tecla
 
-                ParsedPacket pkt;
-                pkt.is_valid = 0;
-
-                // TRANCA O CADEADO: Tenta extrair um pacote do FIFO
-                EnterCriticalSection(&buffer_lock);
-                int available = rx_fifo.size;
-                if (available > 0) {
-                    static uint8_t flat_buffer[RB_CAPACITY];
-                    rb_peek(&rx_fifo, flat_buffer, available);
-
-                    pkt = protocol_parse_buffer(flat_buffer, available);
-                    
-                    if (pkt.bytes_to_consume > 0) {
-                        rb_consume(&rx_fifo, pkt.bytes_to_consume);
-                    }
-                }
-                LeaveCriticalSection(&buffer_lock); // DESTRANCA
-
-          // 4. Se encontrou um pacote matematicamente perfeito:
-                if (pkt.is_valid) {
-                    cJSON *json = cJSON_Parse(pkt.body);
-                    if (json != NULL) {
-                        cJSON *err_info = cJSON_GetObjectItemCaseSensitive(json, "err_info");
-                        cJSON *id_existed = cJSON_GetObjectItemCaseSensitive(json, "id_existed");
-                        cJSON *ft_string = cJSON_GetObjectItemCaseSensitive(json, "ft");
-
-                        int err_val = (err_info != NULL) ? err_info->valueint : -1;
-                        int should_break = 0; // Bandeira para abortar o loop em caso de erro sem vazar memória
-                        
-                        // 1. Tratamento de Erros enviados pelo módulo
-                        if (err_val > 0) {
-                            int id_exist = (id_existed != NULL) ? id_existed->valueint : 0;
-                            if (id_exist == 1 || err_val == 36) { 
-                                printf("\n[ERRO: FACE DUPLICADA]\n"); 
-                                fail_duplicate = 1; 
-                            } else {
-                                // Se for erro de Timeout (ex: 13) ou outro sem ser duplicado
-                                printf("\n[ERRO]\n", err_val);
-                                should_break = 1; 
-                            }
-                        }
-
-                        // 2. Se não há erro e existe a string Base64 ('ft')
-                        else if (err_val == 0 && !fail_duplicate && cJSON_IsString(ft_string) && (ft_string->valuestring != NULL)) {
-                            const char *b64_temp = ft_string->valuestring;
-                            
-                            // --- A NOVA PROTEÇÃO ---
-                            // Ignora se o módulo enviar a palavra "null" ou uma string curta demais
-                            if (strcmp(b64_temp, "null") == 0 || strlen(b64_temp) < 100) {
-                                aux++;
-                                if(aux==3) should_break = 1;
-                            } else {
-                                // É um Base64 autêntico e volumoso!
-                                printf("\n[SUCESSO]\n");
-
-                                size_t b64_len = strlen(b64_temp);
-                                size_t raw_len;
-                                
-                                unsigned char *raw_data = base64_decode(b64_temp, b64_len, &raw_len);
-
-                                if (raw_data) {
-                                    sprintf(filename, "face_%d.bin", next_global_id);
-                                    FILE *fp = fopen(filename, "wb");
-                                    if (fp) {
-                                        UserHeader header;
-                                        header.face_id = next_global_id;
-                                        header.feature_len = (uint16_t)raw_len;
-                                        fwrite(&header, sizeof(UserHeader), 1, fp);
-                                        fwrite(raw_data, 1, raw_len, fp);
-                                        fclose(fp);
-                                        printf("-> Arquivo Salvo: %s\n", filename);
-                                    }
-                                    free(raw_data);
-                                }
-                                next_global_id++; 
-                                success = 1; 
-                            }
-                        }
-                        
-                        cJSON_Delete(json); // Limpeza de memória obrigatória
-                        
-                        // Se houve falha grave (como ausência de rosto), paramos de esperar
-                        if (should_break){
-                            aux=0;
-                            break;
-                        }  
-                    }
-                }
+                // 4. Descodifica só os bytes novos; os pacotes perfeitos vão para on_enroll_packet
+                pump_rx_fifo();
 
-                if (success || fail_duplicate) break; 
-                Sleep(10); 
+                // Se houve falha grave (como ausência de rosto), paramos de esperar
+                if (enroll.success || enroll.fail_duplicate || enroll.should_break) break; 
+                wait_rx_or_key(hSerial, TIMEOUT_MS - elapsed);
             }
-            if (!success && !fail_duplicate) printf("\n[FALHA]\n");
+            if (enroll.success) next_global_id++;
+            if (!enroll.success && !enroll.fail_duplicate) printf("\n[FALHA]\n");
         }
         
         // ==========================================================
@@ -210,13 +458,13 @@ int main() {
             serial_purge(hSerial); 
 
             // Limpa o FIFO antes de iniciar
-            EnterCriticalSection(&buffer_lock);
-            rb_init(&rx_fifo, rb_memory, RB_CAPACITY);
-            LeaveCriticalSection(&buffer_lock);
+            rb_clear(&rx_fifo);
 
-            FacePass_StartRecog(hSerial, &seq);
-            
-            int id_found_flag = 0; 
+            recog.id_found_flag = 0;
+            protocol_decoder_reset(&rx_decoder);
+            protocol_decoder_set_callback(&rx_decoder, on_recog_packet, &recog);
+
+            FacePass_StartRecog(&tx_queue, &seq);
 
             while (1) {
                 // Bloqueio de UI: Espera até uma tecla ser pressionada para sair do modo
@@ -226,51 +474,13 @@ int main() {
                     break; 
                 }
 
-                ParsedPacket pkt;
-                pkt.is_valid = 0;
-
-                // TRANCA O CADEADO: Lê do FIFO
-                EnterCriticalSection(&buffer_lock);
-                int available = rx_fifo.size;
-                if (available > 0) {
-                    static uint8_t flat_buffer[RB_CAPACITY];
-                    rb_peek(&rx_fifo, flat_buffer, available);
-
-                    pkt = protocol_parse_buffer(flat_buffer, available);
-                    
-                    if (pkt.bytes_to_consume > 0) {
-                        rb_consume(&rx_fifo, pkt.bytes_to_consume);
-                    }
-                }
-                LeaveCriticalSection(&buffer_lock); // DESTRANCA
-
-                // Processa o pacote se for válido
-                if (pkt.is_valid) {
-                    cJSON *json = cJSON_Parse(pkt.body);
-                    if (json != NULL) {
-                        int id_val = 0;
-                        int score_val = 0;
-
-                        // A função robusta mapeia o iden_info internamente
-                        id_val = FacePass_ExtractData(json, &score_val);
-
-                        if (id_val > 0) {
-                            printf("\n\nID Reconhecido: %d (Score: %d%%).\nAcesso Permitido.\n", id_val, score_val);
-                            id_found_flag = 1; 
-                            
-                        } else if ((id_val == 0)||((strstr(pkt.uri, "recog") != NULL) || (strstr(pkt.uri, "push") != NULL))) {
-                            // Rosto detectado mas não cadastrado
-                            printf(".");
-                        }
-                        
-                        cJSON_Delete(json);
-                    }
-                }
-                Sleep(10);
+                // Processa os pacotes válidos em on_recog_packet
+                pump_rx_fifo();
+                wait_rx_or_key(hSerial, INFINITE);
             }
 
             // Garante que o hardware para de enviar pacotes de câmara antes de voltar ao menu
-            FacePass_Pause(hSerial, &seq);
+            FacePass_Pause(&tx_queue, &seq); // Faixa CONTROL: sai em poucos ms, bem antes do purge
             Sleep(200); 
             serial_purge(hSerial);
         }
@@ -279,17 +489,28 @@ int main() {
         // --- MODO: LIMPAR TUDO ---
         // ==========================================================
         else if (ch == 'D') {
-            FacePass_DeleteAll(hSerial, &seq);
+            RequestFuture f_del;
+            request_future_init(&f_del);
+            protocol_decoder_set_callback(&rx_decoder, on_control_packet, NULL);
+            FacePass_DeleteAllReq(&tx_queue, &requests, &seq, CMD_TIMEOUT_MS, request_future_cb, &f_del);
             system("del face_*.bin"); 
-            Sleep(500); 
+            wait_requests(hSerial);
+            report_request("Apagar", &f_del);
             next_global_id = 1; 
             printf("\nTodos os Dados Foram DELETADOS.\n");
         }
     }
     
     // 6. Encerramento seguro
+    tx_queue_stop(&tx_queue); // A escritora sai antes de a porta fechar
     serial_close(hSerial); // Já desliga a thread internamente de forma segura
-    DeleteCriticalSection(&buffer_lock); // Destrói o cadeado
+    protocol_decoder_reset(&rx_decoder); // Devolve ao pool um pacote que tenha ficado a meio
+    request_table_destroy(&requests);
+    pool_destroy();
+    rb_destroy(&rx_fifo);
+#if RX_LATENCY_HISTOGRAM
+    lat_print();
+#endif
     
     return 0;
 }
\ No newline at end of file
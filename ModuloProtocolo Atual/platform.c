@@ -0,0 +1,159 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#endif
+#include "platform.h"
+#include <stdlib.h>
+
+// As threads recebem uma OsThreadFunc; o SO espera outra assinatura
+typedef struct {
+    OsThreadFunc fn;
+    void *arg;
+} OsThreadStart;
+
+#ifdef _WIN32
+uint32_t os_now_ms(void) {
+    return (uint32_t)GetTickCount();
+}
+
+uint64_t os_now_us(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000u +
+           (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000u / (uint64_t)freq.QuadPart;
+}
+
+int os_event_init(OsEvent *ev) {
+    *ev = CreateEvent(NULL, FALSE, FALSE, NULL);
+    return *ev != NULL;
+}
+
+void os_event_destroy(OsEvent *ev) {
+    CloseHandle(*ev);
+}
+
+void os_event_set(OsEvent *ev) {
+    SetEvent(*ev);
+}
+
+int os_event_wait(OsEvent *ev, uint32_t timeout_ms) {
+    return WaitForSingleObject(*ev, timeout_ms == OS_WAIT_FOREVER ? INFINITE : timeout_ms) == WAIT_OBJECT_0;
+}
+
+static DWORD WINAPI os_thread_entry(LPVOID p) {
+    OsThreadStart start = *(OsThreadStart*)p;
+    free(p);
+    start.fn(start.arg);
+    return 0;
+}
+
+int os_thread_start(OsThread *t, OsThreadFunc fn, void *arg) {
+    OsThreadStart *start = (OsThreadStart*)malloc(sizeof(OsThreadStart));
+    if (start == NULL) return 0;
+    start->fn = fn;
+    start->arg = arg;
+    *t = CreateThread(NULL, 0, os_thread_entry, start, 0, NULL);
+    if (*t == NULL) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void os_thread_join(OsThread *t) {
+    WaitForSingleObject(*t, INFINITE);
+    CloseHandle(*t);
+}
+
+void os_thread_yield(void) {
+    SwitchToThread();
+}
+#else
+#include <time.h>
+#include <sched.h>
+
+uint32_t os_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u);
+}
+
+uint64_t os_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+int os_event_init(OsEvent *ev) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int ok = pthread_mutex_init(&ev->lock, NULL) == 0 && pthread_cond_init(&ev->cond, &attr) == 0;
+    pthread_condattr_destroy(&attr);
+    ev->signaled = 0;
+    return ok;
+}
+
+void os_event_destroy(OsEvent *ev) {
+    pthread_cond_destroy(&ev->cond);
+    pthread_mutex_destroy(&ev->lock);
+}
+
+void os_event_set(OsEvent *ev) {
+    pthread_mutex_lock(&ev->lock);
+    ev->signaled = 1;
+    pthread_cond_signal(&ev->cond);
+    pthread_mutex_unlock(&ev->lock);
+}
+
+int os_event_wait(OsEvent *ev, uint32_t timeout_ms) {
+    struct timespec deadline;
+    if (timeout_ms != OS_WAIT_FOREVER) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&ev->lock);
+    while (!ev->signaled) {
+        if (timeout_ms == OS_WAIT_FOREVER) pthread_cond_wait(&ev->cond, &ev->lock);
+        else if (pthread_cond_timedwait(&ev->cond, &ev->lock, &deadline) != 0) break;
+    }
+    int got = ev->signaled;
+    ev->signaled = 0; // Auto-reset
+    pthread_mutex_unlock(&ev->lock);
+    return got;
+}
+
+static void *os_thread_entry(void *p) {
+    OsThreadStart start = *(OsThreadStart*)p;
+    free(p);
+    start.fn(start.arg);
+    return NULL;
+}
+
+int os_thread_start(OsThread *t, OsThreadFunc fn, void *arg) {
+    OsThreadStart *start = (OsThreadStart*)malloc(sizeof(OsThreadStart));
+    if (start == NULL) return 0;
+    start->fn = fn;
+    start->arg = arg;
+    if (pthread_create(t, NULL, os_thread_entry, start) != 0) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void os_thread_join(OsThread *t) {
+    pthread_join(*t, NULL);
+}
+
+void os_thread_yield(void) {
+    sched_yield();
+}
+#endif
@@ -0,0 +1,67 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+
+// --- PRIMITIVAS DO SO (Win32 / POSIX) ---
+// Cadeado simples e relógio monotónico, partilhados pelos módulos que não
+// podem depender diretamente de windows.h.
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION OsLock;
+#define os_lock_init(l)    InitializeCriticalSection(l)
+#define os_lock_destroy(l) DeleteCriticalSection(l)
+#define os_lock(l)         EnterCriticalSection(l)
+#define os_unlock(l)       LeaveCriticalSection(l)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t OsLock;
+#define os_lock_init(l)    pthread_mutex_init(l, NULL)
+#define os_lock_destroy(l) pthread_mutex_destroy(l)
+#define os_lock(l)         pthread_mutex_lock(l)
+#define os_unlock(l)       pthread_mutex_unlock(l)
+#endif
+
+// Variável com uma cópia por thread
+#ifdef _WIN32
+#define OS_THREAD_LOCAL __declspec(thread)
+#else
+#define OS_THREAD_LOCAL _Thread_local
+#endif
+
+// Milissegundos de um relógio monotónico (dá a volta aos ~49 dias: comparar
+// sempre diferenças, nunca valores absolutos)
+uint32_t os_now_ms(void);
+// Microssegundos do mesmo relógio (para métricas de latência)
+uint64_t os_now_us(void);
+
+// --- EVENTO AUTO-RESET E THREADS ---
+// os_event_set acorda um os_event_wait (ou o próximo, se ninguém estiver à espera)
+#define OS_WAIT_FOREVER 0xFFFFFFFFu
+
+#ifdef _WIN32
+typedef HANDLE OsEvent;
+typedef HANDLE OsThread;
+#else
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int signaled;
+} OsEvent;
+typedef pthread_t OsThread;
+#endif
+
+typedef void (*OsThreadFunc)(void *arg);
+
+int os_event_init(OsEvent *ev);
+void os_event_destroy(OsEvent *ev);
+void os_event_set(OsEvent *ev);
+// Devolve 1 se o evento foi assinalado, 0 no timeout
+int os_event_wait(OsEvent *ev, uint32_t timeout_ms);
+
+int os_thread_start(OsThread *t, OsThreadFunc fn, void *arg);
+void os_thread_join(OsThread *t);
+// Cede o resto da fatia de tempo (esperas ativas curtas)
+void os_thread_yield(void);
+
+#endif // PLATFORM_H
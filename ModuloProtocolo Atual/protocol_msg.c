@@ -1,102 +1,780 @@
+#ifndef _WIN32
+#define _GNU_SOURCE // memfd/mmap/ftruncate no FIFO espelhado (versão POSIX)
+#endif
 #include "protocol_msg.h"
 #include "serial_transport.h"
+#include "crc32_table.h"
+#include "buffer_pool.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PROTOCOL_X86 1
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PROTOCOL_TARGET(isa)
+#else
+#include <cpuid.h>
+#define PROTOCOL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// --- DETEÇÃO DO CPU ---
+// As rotinas com SIMD (CRC32, procura de padrões, Base64) são escolhidas em tempo de
+// execução conforme o que o processador suporta.
+
+#define CPU_PCLMUL  (1 << 0)   // PCLMULQDQ + SSE4.1
+#define CPU_AVX2    (1 << 1)   // AVX2, com os registos YMM ativados pelo SO
+#define CPU_SSSE3   (1 << 2)   // pshufb (Base64)
+
+static int cpu_features(void) {
+    static volatile int cached = -1; // Corrida inofensiva: todas as threads calculam o mesmo valor
+    int flags = cached;
+    if (flags >= 0) return flags;
+    flags = 0;
+#ifdef PROTOCOL_X86
+    unsigned int r1[4] = {0, 0, 0, 0}, r7[4] = {0, 0, 0, 0};
+    unsigned int max_leaf;
+#if defined(_MSC_VER)
+    __cpuid((int*)r1, 0);
+    max_leaf = r1[0];
+    __cpuid((int*)r1, 1);
+    if (max_leaf >= 7) __cpuidex((int*)r7, 7, 0);
+#else
+    max_leaf = __get_cpuid_max(0, NULL);
+    __get_cpuid(1, &r1[0], &r1[1], &r1[2], &r1[3]);
+    if (max_leaf >= 7) __cpuid_count(7, 0, r7[0], r7[1], r7[2], r7[3]);
+#endif
+    // Folha 1, ECX: bit 1 = PCLMULQDQ, bit 9 = SSSE3, bit 19 = SSE4.1, bit 27 = OSXSAVE, bit 28 = AVX
+    if ((r1[2] & (1u << 1)) && (r1[2] & (1u << 19))) flags |= CPU_PCLMUL;
+    if (r1[2] & (1u << 9)) flags |= CPU_SSSE3;
+    if ((r1[2] & (1u << 27)) && (r1[2] & (1u << 28))) {
+        // O SO tem de guardar os estados XMM e YMM (XCR0 bits 1 e 2)
+        unsigned long long xcr0;
+#if defined(_MSC_VER)
+        xcr0 = _xgetbv(0);
+#else
+        unsigned int lo, hi;
+        __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+        // Folha 7, EBX: bit 5 = AVX2
+        if ((xcr0 & 6) == 6 && (r7[1] & (1u << 5))) flags |= CPU_AVX2;
+    }
+#endif
+    cached = flags;
+    return flags;
+}
 
 // --- TABELA BASE64 ---
 static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static const int mod_table[] = {0, 2, 1};
 
 // --- FUNÇÕES DE CODIFICAÇÃO (BASE64) ---
 
+// Grupos de 3 bytes -> 4 caracteres; 'len' múltiplo de 3
+static void b64_encode_triples_scalar(const uint8_t *src, size_t len, char *dst) {
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t triple = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+        *dst++ = b64_table[(triple >> 18) & 0x3F];
+        *dst++ = b64_table[(triple >> 12) & 0x3F];
+        *dst++ = b64_table[(triple >> 6) & 0x3F];
+        *dst++ = b64_table[triple & 0x3F];
+    }
+}
+
+#ifdef PROTOCOL_X86
+// Método de W. Mula: um shuffle põe cada grupo de 3 bytes em 32 bits, duas
+// multiplicações separam os 4 sextetos e uma tabela de 16 deslocamentos (pshufb)
+// converte cada valor 0..63 no carácter. Lê 16 (ou 28) bytes por passo dos
+// quais usa 12 (ou 24): só enquanto não passar do fim da entrada.
+PROTOCOL_TARGET("ssse3")
+static __m128i b64_encode_block_ssse3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(t0, t1);
+
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i is_upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    reduced = _mm_or_si128(reduced, _mm_and_si128(is_upper, _mm_set1_epi8(13)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(shift_lut, reduced));
+}
+
+PROTOCOL_TARGET("ssse3")
+static void b64_encode_triples_ssse3(const uint8_t *src, size_t len, char *dst) {
+    size_t i = 0, j = 0;
+    for (; i + 16 <= len; i += 12, j += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + j), b64_encode_block_ssse3(in));
+    }
+    b64_encode_triples_scalar(src + i, len / 3 * 3 - i, dst + j);
+}
+
+PROTOCOL_TARGET("avx2")
+static void b64_encode_triples_avx2(const uint8_t *src, size_t len, char *dst) {
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+    size_t i = 0, j = 0;
+    for (; i + 28 <= len; i += 24, j += 32) {
+        // 12 bytes em cada metade: o pshufb não cruza as duas metades do registo
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + i))),
+                                             _mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, spread);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t0, t1);
+
+        __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i is_upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        reduced = _mm256_or_si256(reduced, _mm256_and_si256(is_upper, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_add_epi8(indices, _mm256_shuffle_epi8(shift_lut, reduced)));
+    }
+    b64_encode_triples_ssse3(src + i, len - i, dst + j);
+}
+#endif
+
+typedef void (*B64EncodeFn)(const uint8_t *src, size_t len, char *dst);
+static volatile B64EncodeFn b64_encode_impl = NULL;
+
+static void b64_encode_triples(const uint8_t *src, size_t len, char *dst) {
+    B64EncodeFn fn = b64_encode_impl;
+    if (fn == NULL) {
+        fn = b64_encode_triples_scalar;
+#ifdef PROTOCOL_X86
+        if (cpu_features() & CPU_AVX2) fn = b64_encode_triples_avx2;
+        else if (cpu_features() & CPU_SSSE3) fn = b64_encode_triples_ssse3;
+#endif
+        b64_encode_impl = fn;
+    }
+    fn(src, len, dst);
+}
+
+size_t base64_encoded_length(size_t input_length) {
+    return 4 * ((input_length + 2) / 3);
+}
+
+size_t base64_encode_into(const unsigned char *data, size_t input_length, char *out, size_t out_capacity) {
+    size_t n = base64_encoded_length(input_length);
+    if (n > out_capacity) return 0;
+
+    size_t whole = input_length / 3 * 3;
+    b64_encode_triples(data, whole, out);
+
+    // 1 ou 2 bytes finais com '='
+    size_t rest = input_length - whole;
+    if (rest > 0) {
+        uint32_t triple = (uint32_t)data[whole] << 16;
+        if (rest == 2) triple |= (uint32_t)data[whole + 1] << 8;
+        char *dst = out + whole / 3 * 4;
+        dst[0] = b64_table[(triple >> 18) & 0x3F];
+        dst[1] = b64_table[(triple >> 12) & 0x3F];
+        dst[2] = rest == 2 ? b64_table[(triple >> 6) & 0x3F] : '=';
+        dst[3] = '=';
+    }
+    return n;
+}
+
 char *base64_encode(const unsigned char *data, size_t input_length, size_t *output_length) {
-    *output_length = 4 * ((input_length + 2) / 3);
+    *output_length = base64_encoded_length(input_length);
     char *encoded_data = (char *)malloc(*output_length + 1);
     if (encoded_data == NULL) return NULL;
 
-    for (size_t i = 0, j = 0; i < input_length;) {
-        uint32_t octet_a = i < input_length ? (unsigned char)data[i++] : 0;
-        uint32_t octet_b = i < input_length ? (unsigned char)data[i++] : 0;
-        uint32_t octet_c = i < input_length ? (unsigned char)data[i++] : 0;
-        uint32_t triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
+    base64_encode_into(data, input_length, encoded_data, *output_length);
+    encoded_data[*output_length] = '\0';
+    return encoded_data;
+}
+
+// --- FUNÇÕES DE DESCODIFICAÇÃO (BASE64) ---
+// Estrita: só o alfabeto padrão, sem espaços nem quebras de linha, e '=' apenas
+// nas duas últimas posições. Qualquer outro carácter faz falhar a string inteira.
+
+// Valor de cada carácter do alfabeto (-1 = inválido), fixo em vez de refeito a cada chamada
+static const int8_t b64_decode_table[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
 
-        encoded_data[j++] = b64_table[(triple >> 3 * 6) & 0x3F];
-        encoded_data[j++] = b64_table[(triple >> 2 * 6) & 0x3F];
-        encoded_data[j++] = b64_table[(triple >> 1 * 6) & 0x3F];
-        encoded_data[j++] = b64_table[(triple >> 0 * 6) & 0x3F];
+// Descodifica 'len' caracteres (múltiplo de 4, sem '=') para 'dst'. Devolve 0 se
+// houver um carácter inválido.
+static int b64_decode_quads_scalar(const uint8_t *src, size_t len, uint8_t *dst) {
+    for (size_t i = 0; i < len; i += 4) {
+        int32_t a = b64_decode_table[src[i]], b = b64_decode_table[src[i + 1]];
+        int32_t c = b64_decode_table[src[i + 2]], d = b64_decode_table[src[i + 3]];
+        if ((a | b | c | d) < 0) return 0;
+        uint32_t triple = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
+        *dst++ = (uint8_t)(triple >> 16);
+        *dst++ = (uint8_t)(triple >> 8);
+        *dst++ = (uint8_t)triple;
     }
-    for (int i = 0; i < mod_table[input_length % 3]; i++)
-        encoded_data[*output_length - 1 - i] = '=';
+    return 1;
+}
 
-    encoded_data[*output_length] = '\0';
-    return encoded_data;
+#ifdef PROTOCOL_X86
+// Tradução e validação por blocos (método de W. Mula): os dois nibbles de cada
+// carácter indexam duas tabelas de 16 bytes com pshufb; se as classes não se
+// cruzarem o carácter é inválido. Um deslocamento por classe dá o valor de 6 bits,
+// que é depois compactado (4 x 6 bits -> 3 bytes) com multiplicações e um shuffle.
+// Cada bloco escreve 16 (ou 32) bytes dos quais só 12 (ou 24) são úteis: só se
+// usa enquanto couberem em 'room'.
+PROTOCOL_TARGET("ssse3")
+static int b64_decode_quads_ssse3(const uint8_t *src, size_t len, uint8_t *dst, size_t room) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2F);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0, j = 0;
+
+    for (; i + 16 <= len && j + 16 <= room; i += 16, j += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(in, mask_2f);
+        __m128i classes = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo_nibbles), _mm_shuffle_epi8(lut_hi, hi_nibbles));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(classes, _mm_setzero_si128())) != 0) return 0;
+
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask_2f), hi_nibbles));
+        __m128i sextets = _mm_add_epi8(in, roll);
+        __m128i merged = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i*)(dst + j), _mm_shuffle_epi8(merged, pack));
+    }
+    return b64_decode_quads_scalar(src + i, len - i, dst + j);
+}
+
+PROTOCOL_TARGET("avx2")
+static int b64_decode_quads_avx2(const uint8_t *src, size_t len, uint8_t *dst, size_t room) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7); // Junta os 12 + 12 bytes úteis
+    size_t i = 0, j = 0;
+
+    for (; i + 32 <= len && j + 32 <= room; i += 32, j += 24) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+        __m256i classes = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo_nibbles),
+                                           _mm256_shuffle_epi8(lut_hi, hi_nibbles));
+        if (!_mm256_testz_si256(classes, classes)) return 0;
+
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, mask_2f), hi_nibbles));
+        __m256i sextets = _mm256_add_epi8(in, roll);
+        __m256i merged = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, pack), lanes);
+        _mm256_storeu_si256((__m256i*)(dst + j), merged);
+    }
+    return b64_decode_quads_ssse3(src + i, len - i, dst + j, room - j);
+}
+#endif
+
+static int b64_decode_quads_generic(const uint8_t *src, size_t len, uint8_t *dst, size_t room) {
+    (void)room;
+    return b64_decode_quads_scalar(src, len, dst);
+}
+
+typedef int (*B64DecodeFn)(const uint8_t *src, size_t len, uint8_t *dst, size_t room);
+static volatile B64DecodeFn b64_decode_impl = NULL;
+
+static int b64_decode_quads(const uint8_t *src, size_t len, uint8_t *dst, size_t room) {
+    B64DecodeFn fn = b64_decode_impl;
+    if (fn == NULL) {
+        fn = b64_decode_quads_generic;
+#ifdef PROTOCOL_X86
+        if (cpu_features() & CPU_AVX2) fn = b64_decode_quads_avx2;
+        else if (cpu_features() & CPU_SSSE3) fn = b64_decode_quads_ssse3;
+#endif
+        b64_decode_impl = fn;
+    }
+    return fn(src, len, dst, room);
+}
+
+// Último grupo de 4, o único que pode ter '=' ("xx==" ou "xxx="). Devolve os
+// bytes escritos (1 a 3), ou -1 se for inválido.
+static int b64_decode_last_quad(const uint8_t *q, uint8_t *dst) {
+    int pad = (q[3] == '=') + (q[2] == '=');
+    int32_t a = b64_decode_table[q[0]], b = b64_decode_table[q[1]];
+    int32_t c = pad < 2 ? b64_decode_table[q[2]] : 0;
+    int32_t d = pad < 1 ? b64_decode_table[q[3]] : 0;
+    if ((a | b | c | d) < 0) return -1;
+    uint32_t triple = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
+
+    dst[0] = (uint8_t)(triple >> 16);
+    if (pad < 2) dst[1] = (uint8_t)(triple >> 8);
+    if (pad < 1) dst[2] = (uint8_t)triple;
+    return 3 - pad;
+}
+
+size_t base64_decoded_length(const char *data, size_t input_length) {
+    if (input_length == 0 || input_length % 4 != 0) return 0;
+    size_t n = input_length / 4 * 3;
+    if (data[input_length - 1] == '=') n--;
+    if (data[input_length - 2] == '=') n--;
+    return n;
+}
+
+int base64_decode_into(const char *data, size_t input_length, unsigned char *out, size_t out_capacity,
+                       size_t *output_length) {
+    size_t n = base64_decoded_length(data, input_length);
+    if (n == 0 || n > out_capacity) return 0;
+
+    // Tudo menos o último grupo de 4 vai pelo caminho rápido; o último pode ter '='
+    const uint8_t *src = (const uint8_t*)data;
+    size_t body = input_length - 4;
+    if (!b64_decode_quads(src, body, out, n)) return 0;
+
+    if (b64_decode_last_quad(src + body, out + body / 4 * 3) < 0) return 0;
+
+    *output_length = n;
+    return 1;
 }
 
 unsigned char *base64_decode(const char *data, size_t input_length, size_t *output_length) {
-    if (input_length % 4 != 0) return NULL;
-    *output_length = input_length / 4 * 3;
-    if (data[input_length - 1] == '=') (*output_length)--;
-    if (data[input_length - 2] == '=') (*output_length)--;
+    size_t n = base64_decoded_length(data, input_length);
+    if (n == 0) return NULL;
 
-    unsigned char *decoded_data = (unsigned char *)malloc(*output_length);
+    unsigned char *decoded_data = (unsigned char *)malloc(n);
     if (decoded_data == NULL) return NULL;
+    if (!base64_decode_into(data, input_length, decoded_data, n, output_length)) {
+        free(decoded_data);
+        return NULL;
+    }
+    return decoded_data;
+}
 
-    int decoding_table[256];
-    for (int i = 0; i < 256; i++) decoding_table[i] = -1;
-    for (int i = 0; i < 64; i++) decoding_table[(unsigned char)b64_table[i]] = i;
+// --- BASE64 EM STREAMING ---
 
-    for (size_t i = 0, j = 0; i < input_length;) {
-        uint32_t sextet_a = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
-        uint32_t sextet_b = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
-        uint32_t sextet_c = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
-        uint32_t sextet_d = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
-        uint32_t triple = (sextet_a << 3 * 6) + (sextet_b << 2 * 6) + (sextet_c << 1 * 6) + (sextet_d << 0 * 6);
+void base64_stream_init(Base64Stream *s, Base64Sink sink, void *user) {
+    s->sink = sink;
+    s->user = user;
+    s->pending_len = 0;
+    s->done = 0;
+    s->error = 0;
+    s->total_out = 0;
+}
 
-        if (j < *output_length) decoded_data[j++] = (triple >> 2 * 8) & 0xFF;
-        if (j < *output_length) decoded_data[j++] = (triple >> 1 * 8) & 0xFF;
-        if (j < *output_length) decoded_data[j++] = (triple >> 0 * 8) & 0xFF;
+static int b64_stream_emit(Base64Stream *s, const uint8_t *data, size_t len) {
+    if (len == 0) return 1;
+    if (!s->sink(data, len, s->user)) return 0;
+    s->total_out += len;
+    return 1;
+}
+
+// Um grupo completo de 4 caracteres; se tiver '=' é o último
+static int b64_stream_quad(Base64Stream *s, const uint8_t *q) {
+    int n;
+    if (q[3] == '=' || q[2] == '=') {
+        n = b64_decode_last_quad(q, s->out);
+        s->done = 1;
+    } else {
+        n = b64_decode_quads(q, 4, s->out, 3) ? 3 : -1;
     }
-    return decoded_data;
+    return n >= 0 && b64_stream_emit(s, s->out, (size_t)n);
+}
+
+int base64_stream_feed(Base64Stream *s, const char *data, size_t len) {
+    const uint8_t *p = (const uint8_t*)data;
+    if (s->error) return 0;
+    if (len == 0) return 1;
+    if (s->done) goto fail; // Dados depois do '=' final
+
+    // Completa o grupo que ficou a meio no pedaço anterior
+    if (s->pending_len > 0) {
+        while (s->pending_len < 4 && len > 0) {
+            s->pending[s->pending_len++] = *p++;
+            len--;
+        }
+        if (s->pending_len < 4) return 1;
+        s->pending_len = 0;
+        if (!b64_stream_quad(s, s->pending)) goto fail;
+    }
+
+    // Grupos inteiros, uma janela de cada vez pelo caminho rápido; o grupo com
+    // '=' (se houver) vai à parte e fecha a string
+    while (len >= 4) {
+        if (s->done) goto fail;
+        size_t n = len & ~(size_t)3;
+        if (n > BASE64_STREAM_WINDOW) n = BASE64_STREAM_WINDOW;
+        const uint8_t *eq = (const uint8_t*)memchr(p, '=', n);
+        size_t full = eq ? (size_t)(eq - p) & ~(size_t)3 : n;
+
+        if (full > 0) {
+            if (!b64_decode_quads(p, full, s->out, full / 4 * 3)) goto fail;
+            if (!b64_stream_emit(s, s->out, full / 4 * 3)) goto fail;
+            p += full;
+            len -= full;
+        }
+        if (eq) {
+            if (!b64_stream_quad(s, p)) goto fail;
+            p += 4;
+            len -= 4;
+        }
+    }
+
+    if (len > 0) {
+        if (s->done) goto fail;
+        memcpy(s->pending, p, len);
+        s->pending_len = (int)len;
+    }
+    return 1;
+
+fail:
+    s->error = 1;
+    return 0;
+}
+
+int base64_stream_finish(Base64Stream *s) {
+    if (s->pending_len != 0) s->error = 1; // String cortada a meio de um grupo
+    return !s->error;
+}
+
+int base64_sink_file(const uint8_t *data, size_t len, void *user) {
+    return fwrite(data, 1, len, (FILE*)user) == len;
+}
+
+int base64_sink_memory(const uint8_t *data, size_t len, void *user) {
+    Base64MemSink *m = (Base64MemSink*)user;
+    if (len > m->capacity - m->len) return 0;
+    memcpy(m->data + m->len, data, len);
+    m->len += len;
+    return 1;
 }
 
 // --- FUNÇÕES DE CRC ---
 
+// CRC-16/CCITT-FALSE do cabeçalho (polinómio 0x1021, MSB primeiro, início 0xFFFF).
+// A versão bit-a-bit anterior fazia "crc >>= 1" quando o bit 15 estava a 0, o que
+// colapsava quase todos os cabeçalhos em 0x0000 e não detetava corrupção nenhuma.
+// crc16_table[i] = resultado de 8 passos do polinómio sobre (i << 8).
+static const uint16_t crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
 uint16_t calc_crc16(const uint8_t *data, size_t length) {
     uint16_t crc = 0xFFFF;
     for (size_t i = 0; i < length; i++) {
-        crc ^= (uint16_t)data[i] << 8;
-        for (int j = 0; j < 8; j++) { 
-            if (crc & 0x8000) crc = (crc << 1) ^ 0x1021; 
-            else crc >>= 1; 
-        }
+        crc = (uint16_t)(crc << 8) ^ crc16_table[(crc >> 8) ^ data[i]];
     }
     return crc;
 }
 
-uint32_t calc_crc32(const uint8_t *data, size_t length) {
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) { 
-            if (crc & 1) crc = (crc >> 1) ^ 0xEDB88320; 
-            else crc >>= 1; 
-        }
+// CRC32 slice-by-8: consome 8 bytes por iteração com 8 tabelas de 256 entradas
+// (ver crc32_table.h). Assume little-endian, tal como o ProtocolHeader.
+// Devolve exatamente o mesmo valor que a versão bit-a-bit.
+static uint32_t crc32_update_slice8(uint32_t crc, const uint8_t *data, size_t length) {
+    while (length >= 8) {
+        uint32_t one, two;
+        memcpy(&one, data, 4);     // memcpy evita leituras desalinhadas
+        memcpy(&two, data + 4, 4);
+        one ^= crc;
+        crc = crc32_table[7][one & 0xFF] ^ crc32_table[6][(one >> 8) & 0xFF] ^
+              crc32_table[5][(one >> 16) & 0xFF] ^ crc32_table[4][one >> 24] ^
+              crc32_table[3][two & 0xFF] ^ crc32_table[2][(two >> 8) & 0xFF] ^
+              crc32_table[1][(two >> 16) & 0xFF] ^ crc32_table[0][two >> 24];
+        data += 8;
+        length -= 8;
+    }
+    // Cauda (0 a 7 bytes) byte-a-byte
+    while (length--) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
     }
-    return ~crc;
+    return crc;
+}
+
+#ifdef PROTOCOL_X86
+// CRC32 por "folding" com multiplicação sem transporte (PCLMULQDQ), segundo o
+// artigo da Intel "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+// Constantes para o polinómio refletido 0xEDB88320. Exige length >= 64 e
+// múltiplo de 16; o resto é tratado pela versão slice-by-8.
+PROTOCOL_TARGET("pclmul,sse4.1")
+static uint32_t crc32_update_pclmul(uint32_t crc, const uint8_t *data, size_t length) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+    // Primeiro bloco de 64 bytes com o estado do CRC injetado
+    x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    data += 64;
+    length -= 64;
+
+    // Dobra 4 x 128 bits em paralelo por cada 64 bytes
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 0x30)));
+        data += 64;
+        length -= 64;
+    }
+
+    // Reduz os 4 acumuladores a um só de 128 bits
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Blocos restantes de 16 bytes
+    while (length >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data)), x5);
+        data += 16;
+        length -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Redução de Barrett para 32 bits
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_update_accel(uint32_t crc, const uint8_t *data, size_t length) {
+    if (length >= 64) {
+        size_t chunk = length & ~(size_t)15;
+        crc = crc32_update_pclmul(crc, data, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+    return crc32_update_slice8(crc, data, length);
+}
+#endif
+
+// Implementação escolhida na primeira chamada conforme o CPU (CPUID).
+// A corrida entre threads na inicialização é inofensiva: todas escrevem o mesmo valor.
+typedef uint32_t (*Crc32UpdateFn)(uint32_t crc, const uint8_t *data, size_t length);
+static volatile Crc32UpdateFn crc32_update_impl = NULL;
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length) {
+    Crc32UpdateFn fn = crc32_update_impl;
+    if (fn == NULL) {
+        fn = crc32_update_slice8;
+#ifdef PROTOCOL_X86
+        if (cpu_features() & CPU_PCLMUL) fn = crc32_update_accel;
+#endif
+        crc32_update_impl = fn;
+    }
+    return fn(crc, data, length);
+}
+
+uint32_t calc_crc32(const uint8_t *data, size_t length) {
+    return ~crc32_update(0xFFFFFFFF, data, length);
+}
+
+uint32_t calc_crc32_portable(const uint8_t *data, size_t length) {
+    return ~crc32_update_slice8(0xFFFFFFFF, data, length);
+}
+
+// --- CRC32 INCREMENTAL ---
+
+void crc32_stream_init(Crc32Stream *s) {
+    s->state = 0xFFFFFFFF;
+    s->length = 0;
+}
+
+void crc32_stream_update(Crc32Stream *s, const uint8_t *data, size_t len) {
+    if (len == 0) return;
+    s->state = crc32_update(s->state, data, len);
+    s->length += (uint32_t)len;
+}
+
+uint32_t crc32_stream_final(const Crc32Stream *s) {
+    return ~s->state;
 }
 
 // --- FUNÇÕES DE PARSING ---
 
-int find_pattern_index(const uint8_t *buffer, int buffer_len, const char *pattern) {
-    int pattern_len = strlen(pattern);
-    if (buffer_len < pattern_len) return -1;
-    for (int i = 0; i <= buffer_len - pattern_len; i++) {
-        if (buffer[i] == pattern[0]) { 
-            if (memcmp(buffer + i, pattern, pattern_len) == 0) return i;
+// Procura genérica de um padrão de vários bytes. Compara em bloco o primeiro e
+// o último byte do padrão em 16/32 posições de cada vez e só confirma com memcmp
+// as posições onde ambos coincidem (quase nunca, em ruído ou Base64).
+static const uint8_t *scan_pattern_scalar(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len) {
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len - pat_len + 1; // Última posição de início possível + 1
+    while (p < end) {
+        p = (const uint8_t*)memchr(p, pat[0], (size_t)(end - p));
+        if (p == NULL) return NULL;
+        if (memcmp(p, pat, pat_len) == 0) return p;
+        p++;
+    }
+    return NULL;
+}
+
+#ifdef PROTOCOL_X86
+#if defined(_MSC_VER)
+static int ctz32(uint32_t v) { unsigned long idx; _BitScanForward(&idx, v); return (int)idx; }
+#else
+#define ctz32(v) __builtin_ctz(v)
+#endif
+
+// SSE2 faz parte da base do x86-64, não precisa de deteção
+static const uint8_t *scan_pattern_sse2(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len) {
+    const __m128i first = _mm_set1_epi8((char)pat[0]);
+    const __m128i last = _mm_set1_epi8((char)pat[pat_len - 1]);
+    size_t i = 0;
+    for (; i + pat_len - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(buf + i + pat_len - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                                 _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0) {
+            size_t pos = i + ctz32(mask);
+            if (memcmp(buf + pos, pat, pat_len) == 0) return buf + pos;
+            mask &= mask - 1;
+        }
+    }
+    return scan_pattern_scalar(buf + i, len - i, pat, pat_len);
+}
+
+PROTOCOL_TARGET("avx2")
+static const uint8_t *scan_pattern_avx2(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len) {
+    const __m256i first = _mm256_set1_epi8((char)pat[0]);
+    const __m256i last = _mm256_set1_epi8((char)pat[pat_len - 1]);
+    size_t i = 0;
+    for (; i + pat_len - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(buf + i + pat_len - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                                                       _mm256_cmpeq_epi8(last, block_last)));
+        while (mask != 0) {
+            size_t pos = i + ctz32(mask);
+            if (memcmp(buf + pos, pat, pat_len) == 0) return buf + pos;
+            mask &= mask - 1;
         }
     }
-    return -1; 
+    return scan_pattern_sse2(buf + i, len - i, pat, pat_len);
+}
+#endif
+
+typedef const uint8_t *(*ScanPatternFn)(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len);
+static volatile ScanPatternFn scan_pattern_impl = NULL;
+
+// Devolve o ponteiro para a primeira ocorrência de 'pat' em 'buf', ou NULL
+static const uint8_t *scan_pattern(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len) {
+    if (pat_len == 0 || len < pat_len) return NULL;
+    ScanPatternFn fn = scan_pattern_impl;
+    if (fn == NULL) {
+        fn = scan_pattern_scalar;
+#ifdef PROTOCOL_X86
+        fn = (cpu_features() & CPU_AVX2) ? scan_pattern_avx2 : scan_pattern_sse2;
+#endif
+        scan_pattern_impl = fn;
+    }
+    return fn(buf, len, pat, pat_len);
+}
+
+int find_pattern_index(const uint8_t *buffer, int buffer_len, const char *pattern) {
+    if (buffer_len <= 0) return -1;
+    const uint8_t *p = scan_pattern(buffer, (size_t)buffer_len, (const uint8_t*)pattern, strlen(pattern));
+    return p ? (int)(p - buffer) : -1;
 }
 
 int extract_int_safe(const uint8_t *buffer, int len, const char *key) {
@@ -105,18 +783,150 @@ int extract_int_safe(const uint8_t *buffer, int len, const char *key) {
     return -1;
 }
 
-// --- NÚCLEO DO PROTOCOLO: ENVIO DE MENSAGEM ---
+// --- LEITURA DIRETA DE JSON (corpo em bruto, sem '\0' no fim) ---
 
-int protocol_send_msg(HANDLE hSerial, const char* uri, const char* body, uint16_t seq) {
-    if (!hSerial || !uri) return -1;
+#define JSON_IS_WS(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
 
-    static uint8_t tx_buffer[20480]; 
-    ProtocolHeader *h = (ProtocolHeader*)tx_buffer;
-    
+static const char *json_skip_ws(const char *p, const char *end) {
+    while (p < end && JSON_IS_WS(*p)) p++;
+    return p;
+}
+
+// Fim de uma string começada em p (no '"' de abertura); NULL se não fechar.
+// Salta de aspa em aspa com memchr (o 'ft' tem dezenas de KB): uma aspa só
+// fecha a string se tiver um número par de '\' antes.
+static const char *json_skip_string(const char *p, const char *end) {
+    const char *open = p;
+    for (p++; p < end;) {
+        const char *q = (const char*)memchr(p, '"', (size_t)(end - p));
+        if (q == NULL) return NULL;
+        size_t slashes = 0;
+        while (q - slashes - 1 > open && *(q - slashes - 1) == '\\') slashes++;
+        if ((slashes & 1) == 0) return q + 1;
+        p = q + 1;
+    }
+    return NULL;
+}
+
+// Salta um valor qualquer (objetos e arrays contam a profundidade); devolve o
+// primeiro carácter depois dele, ou NULL se não terminar
+static const char *json_skip_value(const char *p, const char *end) {
+    if (p == end) return NULL;
+    if (*p == '"') return json_skip_string(p, end);
+    if (*p != '{' && *p != '[') {
+        // Número ou literal (true, false, null): até ao separador
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && !JSON_IS_WS(*p)) p++;
+        return p;
+    }
+    int depth = 0;
+    while (p < end) {
+        if (*p == '"') {
+            p = json_skip_string(p, end);
+            if (p == NULL) return NULL;
+            continue;
+        }
+        if (*p == '{' || *p == '[') depth++;
+        else if ((*p == '}' || *p == ']') && --depth == 0) return p + 1;
+        p++;
+    }
+    return NULL;
+}
+
+// Número em [p, end) para int, como o valueint do cJSON: fração e expoente
+// contam (1.9e1 = 19), o resultado é truncado e saturado em INT_MAX/INT_MIN.
+// Com 'integer_only' imita o atoi (ids que vêm em string): sinal e dígitos,
+// parando no primeiro outro carácter. Devolve 0 se não houver nenhum dígito.
+static int json_parse_int(const char *p, const char *end, int integer_only, int *out) {
+    p = json_skip_ws(p, end);
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    double mantissa = 0.0;
+    int exponent = 0, digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) mantissa = mantissa * 10.0 + (*p - '0');
+    if (!integer_only) {
+        if (p < end && *p == '.') {
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+                mantissa = mantissa * 10.0 + (*p - '0');
+                exponent--;
+            }
+        }
+        if (digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+            int exp_negative = 0, exp_value = 0;
+            p++;
+            if (p < end && (*p == '-' || *p == '+')) exp_negative = *p++ == '-';
+            for (; p < end && *p >= '0' && *p <= '9'; p++) {
+                if (exp_value < 1000) exp_value = exp_value * 10 + (*p - '0'); // Já é 0 ou infinito
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+    }
+    if (digits == 0) return 0;
+
+    for (; exponent > 0; exponent--) mantissa *= 10.0;
+    for (; exponent < 0; exponent++) mantissa /= 10.0;
+    if (negative) mantissa = -mantissa;
+
+    if (mantissa >= (double)INT_MAX) *out = INT_MAX;
+    else if (mantissa <= (double)INT_MIN) *out = INT_MIN;
+    else *out = (int)mantissa;
+    return 1;
+}
+
+// Posição do valor de "key" no objeto raiz (depois dos ':' e espaços), ou NULL.
+// Percorre só as chaves da raiz: os valores (strings, objetos aninhados) são
+// saltados inteiros, por isso nem um "key" dentro de iden_info nem um texto
+// igual à chave dentro de uma string são confundidos com ela.
+static const char *json_find_value(const char *body, size_t len, const char *key) {
+    size_t key_len = strlen(key);
+    const char *end = body + len;
+    const char *p = json_skip_ws(body, end);
+    if (p == end || *p != '{') return NULL;
+    p = json_skip_ws(p + 1, end);
+
+    while (p < end && *p == '"') {
+        const char *name = p + 1;
+        p = json_skip_string(p, end);
+        if (p == NULL) return NULL;
+        size_t name_len = (size_t)(p - 1 - name);
+        p = json_skip_ws(p, end);
+        if (p == end || *p != ':') return NULL;
+        p = json_skip_ws(p + 1, end);
+        if (p == end) return NULL;
+        if (name_len == key_len && memcmp(name, key, key_len) == 0) return p;
+
+        p = json_skip_value(p, end);
+        if (p == NULL) return NULL;
+        p = json_skip_ws(p, end);
+        if (p == end || *p != ',') return NULL; // '}' = fim da raiz sem a chave
+        p = json_skip_ws(p + 1, end);
+    }
+    return NULL;
+}
+
+int protocol_json_find_int(const char *body, size_t len, const char *key, int *out) {
+    const char *p = json_find_value(body, len, key);
+    if (p == NULL || (*p != '-' && (*p < '0' || *p > '9'))) return 0; // Só números
+    // O corpo não termina em '\0': nada de atoi/strtod aqui
+    return json_parse_int(p, body + len, 0, out);
+}
+
+int protocol_json_find_string(const char *body, size_t len, const char *key, const char **value, size_t *value_len) {
+    const char *p = json_find_value(body, len, key);
+    if (p == NULL || *p != '"') return 0;
+    const char *after = json_skip_string(p, body + len); // Respeita os \"
+    if (after == NULL) return 0;
+    *value = p + 1;
+    *value_len = (size_t)(after - 1 - (p + 1));
+    return 1;
+}
+
+// --- NÚCLEO DO PROTOCOLO: ENVIO DE MENSAGEM ---
+
+int protocol_build_header(ProtocolHeader *h, const char *uri, const uint8_t *body, uint32_t body_len, uint16_t seq) {
     uint32_t uri_len = strlen(uri) + 1; 
-    uint32_t body_len = body ? strlen(body) : 0;
-    
-    // Monta os campos principais
+    if (uri_len > 255 || sizeof(ProtocolHeader) + uri_len + body_len > PROTOCOL_MAX_MSG_LEN) return 0;
+
     h->sync_flag = SYNC_FLAG_VALUE; 
     h->head_len = sizeof(ProtocolHeader); // 20 bytes
     h->uri_len = (uint8_t)uri_len;
@@ -125,33 +935,123 @@ int protocol_send_msg(HANDLE hSerial, const char* uri, const char* body, uint16_
     h->type = 0; 
     h->need_resp = 1;
     
-    // Copia URI e BODY para o buffer sequencialmente
-    memcpy(tx_buffer + h->head_len, uri, uri_len); 
-    if(body_len > 0) {
-        memcpy(tx_buffer + h->head_len + uri_len, body, body_len);
-    }
-    
-    // Calcula CRCs
+    // Calcula CRCs: o CRC16 cobre o fim do cabeçalho; o CRC32 vai do byte 8
+    // até ao fim e é calculado por partes, sobre cada segmento no seu sítio
     uint8_t *header_bytes = (uint8_t*)h; 
     h->head_crc16 = calc_crc16(header_bytes + 12, 8); 
-    h->msg_crc32 = calc_crc32(tx_buffer + 8, h->msg_len - 8);
+    Crc32Stream crc;
+    crc32_stream_init(&crc);
+    crc32_stream_update(&crc, header_bytes + 8, sizeof(ProtocolHeader) - 8);
+    crc32_stream_update(&crc, (const uint8_t*)uri, uri_len);
+    crc32_stream_update(&crc, body, body_len);
+    h->msg_crc32 = crc32_stream_final(&crc);
+    return 1;
+}
+
+int protocol_send_msg(SerialHandle hSerial, const char* uri, const char* body, uint16_t seq) {
+    if (!hSerial || !uri) return -1;
+
+    // Só o cabeçalho é montado aqui: a URI (com o '\0') e o BODY são enviados
+    // diretamente de onde estão, sem cópia para um buffer de envio
+    uint32_t body_len = body ? strlen(body) : 0;
+    ProtocolHeader h;
+    if (!protocol_build_header(&h, uri, (const uint8_t*)body, body_len, seq)) return -1;
     
-    // Chama a Camada 1 para fazer o envio real para o Hardware
-    return serial_write(hSerial, tx_buffer, h->msg_len);
+    // Chama a Camada 1 para fazer o envio real para o Hardware (um só envio vetorial)
+    SerialSegment segs[3] = {
+        { &h, sizeof(ProtocolHeader) },
+        { uri, h.uri_len },
+        { body, body_len },
+    };
+    return serial_writev(hSerial, segs, body_len > 0 ? 3 : 2);
+}
+
+// Preenche o ParsedPacket a partir de um pacote completo e já validado.
+// Não copia nada: a URI e o BODY ficam a apontar para dentro de 'frame'.
+static void packet_from_frame(ParsedPacket *pkt, const uint8_t *frame) {
+    const ProtocolHeader *h = (const ProtocolHeader*)frame;
+    pkt->is_valid = 1;
+    pkt->buffer = NULL;
+    pkt->bytes_to_consume = 0;
+    pkt->type = h->type;
+    pkt->serial = h->serial;
+
+    // A URI vem normalmente com o '\0' incluído no uri_len
+    pkt->uri = (const char*)frame + h->head_len;
+    pkt->uri_len = h->uri_len;
+    while (pkt->uri_len > 0 && pkt->uri[pkt->uri_len - 1] == '\0') pkt->uri_len--;
+
+    // O BODY (JSON) é o resto do pacote
+    pkt->body = (const char*)frame + h->head_len + h->uri_len;
+    pkt->body_len = h->msg_len - h->head_len - h->uri_len;
+}
+
+void protocol_packet_release(ParsedPacket *pkt) {
+    if (!pkt) return;
+    pool_release(pkt->buffer); // Devolve o buffer ao pool (NULL = buffer do chamador)
+    memset(pkt, 0, sizeof(ParsedPacket));
+}
+
+int protocol_uri_contains(const ParsedPacket *pkt, const char *text) {
+    if (!pkt->uri) return 0;
+    return scan_pattern((const uint8_t*)pkt->uri, pkt->uri_len, (const uint8_t*)text, strlen(text)) != NULL;
+}
+
+// O tamanho do pacote declarado no cabeçalho faz sentido?
+static int header_sizes_valid(const ProtocolHeader *h) {
+    if (h->msg_len < sizeof(ProtocolHeader) || h->msg_len > PROTOCOL_MAX_MSG_LEN) return 0;
+    if (h->head_len < sizeof(ProtocolHeader) || (uint32_t)h->head_len + h->uri_len > h->msg_len) return 0;
+    return 1;
+}
+
+// O CRC16 cobre os 8 bytes a seguir a ele (head_len .. need_resp), como no envio
+static int header_crc16_matches(const ProtocolHeader *h) {
+    return h->head_crc16 == calc_crc16((const uint8_t*)h + 12, 8);
 }
 
-ParsedPacket protocol_parse_buffer(const uint8_t *buffer, int current_len) {
+int protocol_header_is_valid(const ProtocolHeader *h) {
+    if (!header_sizes_valid(h)) return 0;
+#if PROTOCOL_CHECK_HEAD_CRC16
+    if (!header_crc16_matches(h)) return 0;
+#endif
+    return 1;
+}
+
+void protocol_parse_reset(ProtocolParseState *st) {
+    if (st) st->active = 0;
+}
+
+// Avança o CRC do pacote no índice 0 até aos bytes disponíveis (no máximo msg_len).
+// Identificamos o pacote pelo cabeçalho completo (inclui msg_crc32 e serial), e a
+// cada chamada só os bytes novos são processados: nunca é hasheado duas vezes.
+static void rx_crc_advance(ProtocolParseState *st, const uint8_t *buffer, int available) {
+    const ProtocolHeader *h = (const ProtocolHeader*)buffer;
+    if (!st->active || memcmp(&st->header, h, sizeof(ProtocolHeader)) != 0) {
+        st->header = *h;
+        crc32_stream_init(&st->crc);
+        st->active = 1;
+    }
+
+    // O CRC32 ignora os primeiros 8 bytes (sync_flag e o próprio msg_crc32)
+    uint32_t end = (uint32_t)available < h->msg_len ? (uint32_t)available : h->msg_len;
+    uint32_t done = 8 + st->crc.length;
+    if (end > done) {
+        crc32_stream_update(&st->crc, buffer + done, end - done);
+    }
+}
+
+ParsedPacket protocol_parse_buffer(ProtocolParseState *st, const uint8_t *buffer, int current_len) {
     ParsedPacket pkt;
     memset(&pkt, 0, sizeof(ParsedPacket));
 
-    // 1. Procura o início do pacote (SYNC_FLAG)
+    // 1. Procura o início do pacote (SYNC_FLAG, em little-endian: EB CF 79 00)
+    static const uint8_t sync_bytes[4] = {
+        SYNC_FLAG_VALUE & 0xFF, (SYNC_FLAG_VALUE >> 8) & 0xFF, (SYNC_FLAG_VALUE >> 16) & 0xFF, (SYNC_FLAG_VALUE >> 24) & 0xFF
+    };
     int sync_idx = -1;
-    for (int i = 0; i <= current_len - 4; i++) {
-        uint32_t *flag = (uint32_t*)(buffer + i);
-        if (*flag == SYNC_FLAG_VALUE) {
-            sync_idx = i;
-            break;
-        }
+    if (current_len >= 4) {
+        const uint8_t *sync = scan_pattern(buffer, (size_t)current_len, sync_bytes, sizeof(sync_bytes));
+        if (sync) sync_idx = (int)(sync - buffer);
     }
 
     // Se não encontrou o início, não há nada a fazer.
@@ -164,6 +1064,7 @@ ParsedPacket protocol_parse_buffer(const uint8_t *buffer, int current_len) {
     // Se o pacote não começa na posição 0, significa que há "lixo" antes dele.
     // Pedimos para o main.c consumir esse lixo primeiro e tentar na próxima vez.
     if (sync_idx > 0) {
+        protocol_parse_reset(st);
         pkt.bytes_to_consume = sync_idx;
         return pkt;
     }
@@ -175,20 +1076,25 @@ ParsedPacket protocol_parse_buffer(const uint8_t *buffer, int current_len) {
 
     ProtocolHeader *h = (ProtocolHeader*)buffer;
     
-    // O tamanho do pacote declarado no cabeçalho faz sentido?
-    if (h->msg_len < sizeof(ProtocolHeader) || h->msg_len > 400000) {
+    // O cabeçalho é íntegro? Validamos logo que chegam os 20 bytes, para não
+    // ficarmos à espera de um msg_len corrompido (até 400 KB) que nunca vai chegar.
+    if (!protocol_header_is_valid(h)) {
+        protocol_parse_reset(st);
         pkt.bytes_to_consume = 1; // Cabeçalho corrompido, salta um byte para procurar novo pacote
         return pkt;
     }
 
+    // Vai calculando o CRC32 sobre o que já chegou, mesmo com o pacote incompleto
+    if (st) rx_crc_advance(st, buffer, current_len);
+
     // Já recebemos o pacote inteiro?
     if (current_len < h->msg_len) {
         return pkt; // Ainda a descarregar, espera!
     }
 
-    // TEMOS O PACOTE INTEIRO! VALIDAÇÃO CRC32.
-    // O CRC32 ignora os primeiros 8 bytes (sync_flag e o próprio msg_crc32)
-    uint32_t calc_crc = calc_crc32(buffer + 8, h->msg_len - 8);
+    // TEMOS O PACOTE INTEIRO! VALIDAÇÃO CRC32 (já calculado incrementalmente, se houver estado).
+    uint32_t calc_crc = st ? crc32_stream_final(&st->crc) : calc_crc32(buffer + 8, h->msg_len - 8);
+    protocol_parse_reset(st);
     if (h->msg_crc32 != calc_crc) {
         // CRC FALHOU! Ocorreu ruído elétrico e os bytes corromperam.
         // Rejeitamos o pacote saltando 1 byte para obrigar a recomeçar a busca.
@@ -197,24 +1103,280 @@ ParsedPacket protocol_parse_buffer(const uint8_t *buffer, int current_len) {
     }
 
     // PACOTE VALIDADO E PERFEITO! 
-    pkt.is_valid = 1;
+    packet_from_frame(&pkt, buffer);
     pkt.bytes_to_consume = h->msg_len; // O main.c vai apagar este pacote do buffer
-    pkt.type = h->type;
-    pkt.serial = h->serial;
+    return pkt;
+}
+
+// --- DESCODIFICADOR INCREMENTAL ---
+
+static const uint8_t sync_bytes[4] = {
+    SYNC_FLAG_VALUE & 0xFF, (SYNC_FLAG_VALUE >> 8) & 0xFF, (SYNC_FLAG_VALUE >> 16) & 0xFF, (SYNC_FLAG_VALUE >> 24) & 0xFF
+};
+
+void protocol_decoder_init(ProtocolDecoder *dec, PacketCallback on_packet, void *user) {
+    memset(dec, 0, sizeof(ProtocolDecoder));
+    dec->on_packet = on_packet;
+    dec->user = user;
+    dec->state = DECODER_HUNT_SYNC;
+}
 
-    // Extrai a URI de forma segura
-    if (h->uri_len > 0 && h->uri_len < sizeof(pkt.uri)) {
-        memcpy(pkt.uri, buffer + h->head_len, h->uri_len);
+void protocol_decoder_set_callback(ProtocolDecoder *dec, PacketCallback on_packet, void *user) {
+    dec->on_packet = on_packet;
+    dec->user = user;
+}
+
+// Volta a procurar o SYNC (mantém as estatísticas). Devolve ao pool o pacote a meio.
+void protocol_decoder_reset(ProtocolDecoder *dec) {
+    pool_release(dec->frame);
+    dec->frame = NULL;
+    dec->state = DECODER_HUNT_SYNC;
+    dec->have = 0;
+}
+
+// Cabeçalho rejeitado: o SYNC era falso, mas um SYNC verdadeiro pode começar
+// dentro dos 19 bytes seguintes. Só esses (no máximo 19) são re-examinados.
+static void decoder_resync_header(ProtocolDecoder *dec) {
+    uint8_t rest[sizeof(ProtocolHeader) - 1];
+    memcpy(rest, dec->head + 1, sizeof(rest));
+    dec->bytes_discarded += 1;
+    protocol_decoder_reset(dec);
+    protocol_decoder_feed(dec, rest, sizeof(rest)); // 19 bytes nunca completam outro cabeçalho
+}
+
+// Pacote completo: compara o CRC32 e entrega-o. Se o corpo ainda estiver no
+// FIFO (modo "in place"), só agora é copiado para um buffer do pool, e apenas
+// se o CRC bateu certo e alguém o vai usar.
+static void decoder_validate(ProtocolDecoder *dec, const RxSpan *body) {
+    if (crc32_stream_final(&dec->crc) != dec->header.msg_crc32) {
+        // Como o cabeçalho passou no CRC16, confiamos no msg_len: o pacote
+        // inteiro é descartado sem voltar a ler os seus bytes.
+        dec->crc_errors++;
+        dec->bytes_discarded += dec->header.msg_len;
+        protocol_decoder_reset(dec);
+        return;
     }
 
-    // Extrai o BODY (JSON)
-    int body_len = h->msg_len - h->head_len - h->uri_len;
-    if (body_len > 0 && body_len < sizeof(pkt.body)) {
-        memcpy(pkt.body, buffer + h->head_len + h->uri_len, body_len);
-        pkt.body[body_len] = '\0'; // Garante que a string tem fim
+    dec->frames_ok++;
+    if (dec->on_packet && dec->frame == NULL) {
+        dec->frame = pool_acquire(dec->header.msg_len);
+        if (dec->frame == NULL) {
+            dec->oversized++;
+            protocol_decoder_reset(dec);
+            return;
+        }
+        memcpy(dec->frame->data, dec->head, sizeof(ProtocolHeader));
+        if (body) {
+            uint8_t *dst = dec->frame->data + sizeof(ProtocolHeader);
+            memcpy(dst, body->data[0], body->len[0]);
+            memcpy(dst + body->len[0], body->data[1], body->len[1]);
+        }
     }
+    if (dec->on_packet) {
+        // O buffer do pool passa a pertencer ao pacote entregue ao callback
+        ParsedPacket pkt;
+        packet_from_frame(&pkt, dec->frame->data);
+        pkt.buffer = dec->frame;
+        dec->frame = NULL;
+        dec->on_packet(&pkt, dec->user);
+    }
+    protocol_decoder_reset(dec);
+}
 
-    return pkt;
+// Corre a máquina de estados sobre um bloco contíguo e devolve quantos bytes usou.
+// Com 'in_place' pára à entrada do BODY: o corpo é tratado pelo chamador sem cópia.
+static size_t decoder_run(ProtocolDecoder *dec, const uint8_t *data, size_t len, int in_place) {
+    const uint8_t *start = data;
+
+    while (len > 0 || dec->state == DECODER_VALIDATE) {
+        switch (dec->state) {
+        case DECODER_HUNT_SYNC: {
+            // SYNC partido entre duas chamadas: continua a comparar byte a byte.
+            // Os 4 bytes do SYNC são todos diferentes, logo uma falha recomeça do zero.
+            if (dec->have > 0) {
+                if (data[0] == sync_bytes[dec->have]) {
+                    dec->head[dec->have++] = data[0];
+                    data++; len--;
+                    if (dec->have == sizeof(sync_bytes)) dec->state = DECODER_HEADER;
+                } else {
+                    dec->bytes_discarded += dec->have;
+                    dec->have = 0;
+                }
+                break;
+            }
+
+            const uint8_t *sync = scan_pattern(data, len, sync_bytes, sizeof(sync_bytes));
+            if (sync) {
+                dec->bytes_discarded += (uint32_t)(sync - data);
+                memcpy(dec->head, sync_bytes, sizeof(sync_bytes));
+                dec->have = sizeof(sync_bytes);
+                dec->state = DECODER_HEADER;
+                len -= (size_t)(sync - data) + sizeof(sync_bytes);
+                data = sync + sizeof(sync_bytes);
+            } else {
+                // Guarda um eventual início de SYNC no fim do bloco (1 a 3 bytes)
+                size_t keep = len < 3 ? len : 3;
+                while (keep > 0 && memcmp(data + len - keep, sync_bytes, keep) != 0) keep--;
+                dec->bytes_discarded += (uint32_t)(len - keep);
+                memcpy(dec->head, data + len - keep, keep);
+                dec->have = (uint32_t)keep;
+                data += len;
+                len = 0;
+            }
+            break;
+        }
+
+        case DECODER_HEADER: {
+            size_t n = sizeof(ProtocolHeader) - dec->have;
+            if (n > len) n = len;
+            memcpy(dec->head + dec->have, data, n);
+            dec->have += (uint32_t)n;
+            data += n; len -= n;
+            if (dec->have < sizeof(ProtocolHeader)) break;
+
+            memcpy(&dec->header, dec->head, sizeof(ProtocolHeader));
+            if (!header_sizes_valid(&dec->header)) {
+                dec->header_errors++;
+                decoder_resync_header(dec);
+                break;
+            }
+            // Com a validação desligada o CRC16 é só contado: diz se é seguro ligá-la
+            if (!header_crc16_matches(&dec->header)) {
+                if (dec->head_crc16_mismatches++ == 0) {
+                    printf("[AVISO] head_crc16 0x%04X, esperado 0x%04X (serial %u)%s\n",
+                           dec->header.head_crc16, calc_crc16(dec->head + 12, 8), dec->header.serial,
+                           PROTOCOL_CHECK_HEAD_CRC16 ? "" : ": aceite, PROTOCOL_CHECK_HEAD_CRC16 = 0");
+                }
+#if PROTOCOL_CHECK_HEAD_CRC16
+                dec->header_errors++;
+                decoder_resync_header(dec);
+                break;
+#endif
+            }
+            // O CRC32 ignora os primeiros 8 bytes (sync_flag e o próprio msg_crc32)
+            crc32_stream_init(&dec->crc);
+            crc32_stream_update(&dec->crc, dec->head + 8, sizeof(ProtocolHeader) - 8);
+            if (dec->have == dec->header.msg_len) {
+                dec->state = DECODER_VALIDATE;
+            } else {
+                dec->state = DECODER_BODY;
+                if (in_place) return (size_t)(data - start);
+            }
+            break;
+        }
+
+        case DECODER_BODY: {
+            // Só agora sabemos o tamanho: pede ao pool um buffer para o pacote inteiro
+            if (dec->frame == NULL) {
+                dec->frame = pool_acquire(dec->header.msg_len);
+                if (dec->frame == NULL) {
+                    dec->oversized++;
+                    dec->state = DECODER_SKIP;
+                    break;
+                }
+                memcpy(dec->frame->data, dec->head, sizeof(ProtocolHeader));
+            }
+            size_t n = dec->header.msg_len - dec->have;
+            if (n > len) n = len;
+            memcpy(dec->frame->data + dec->have, data, n);
+            crc32_stream_update(&dec->crc, data, n);
+            dec->have += (uint32_t)n;
+            data += n; len -= n;
+            if (dec->have == dec->header.msg_len) dec->state = DECODER_VALIDATE;
+            break;
+        }
+
+        case DECODER_SKIP: {
+            size_t n = dec->header.msg_len - dec->have;
+            if (n > len) n = len;
+            dec->have += (uint32_t)n;
+            dec->bytes_discarded += (uint32_t)n;
+            data += n; len -= n;
+            if (dec->have == dec->header.msg_len) {
+                dec->bytes_discarded += sizeof(ProtocolHeader);
+                protocol_decoder_reset(dec);
+            }
+            break;
+        }
+
+        case DECODER_VALIDATE:
+            decoder_validate(dec, NULL);
+            break;
+        }
+    }
+    return (size_t)(data - start);
+}
+
+// Um decoder usa só um dos dois modos (ver protocol_msg.h). Se o pacote em curso
+// foi começado pelo outro, os bytes já vistos não estão onde este modo os espera:
+// o pacote é largado e o decoder volta a procurar o SYNC.
+static void decoder_drop_other_mode(ProtocolDecoder *dec) {
+    dec->bytes_discarded += dec->have;
+    protocol_decoder_reset(dec);
+}
+
+void protocol_decoder_feed(ProtocolDecoder *dec, const uint8_t *data, size_t len) {
+    // Corpo "in place" a meio: os bytes dele ficaram no FIFO de quem chamou o feed_span
+    if (dec->state == DECODER_BODY && dec->frame == NULL && dec->have > sizeof(ProtocolHeader)) {
+        decoder_drop_other_mode(dec);
+    }
+    decoder_run(dec, data, len, 0);
+}
+
+// Devolve os 'len' bytes da zona legível que começam em 'offset' (no máximo 2 pedaços)
+static void span_slice(const RxSpan *span, size_t offset, size_t len, RxSpan *out) {
+    size_t skip0 = offset < span->len[0] ? offset : span->len[0];
+    size_t n0 = span->len[0] - skip0;
+    if (n0 > len) n0 = len;
+    out->data[0] = span->data[0] + skip0;
+    out->len[0] = n0;
+    out->data[1] = span->data[1] + (offset - skip0);
+    out->len[1] = len - n0;
+}
+
+size_t protocol_decoder_feed_span(ProtocolDecoder *dec, const RxSpan *span) {
+    size_t total = span->len[0] + span->len[1];
+    size_t pos = 0;          // Próximo byte ainda não visto pelo decoder
+    size_t body_start = 0;   // Onde começa, na zona legível, o corpo do pacote em curso
+
+    if (dec->state == DECODER_BODY) {
+        if (dec->frame == NULL) {
+            // O corpo já visto nas chamadas anteriores continua no FIFO: não o repetimos
+            pos = dec->have - sizeof(ProtocolHeader);
+        } else {
+            // Pacote começado pelo protocol_decoder_feed: o span não começa no seu corpo
+            decoder_drop_other_mode(dec);
+        }
+    }
+
+    while (pos < total || dec->state == DECODER_VALIDATE) {
+        if (dec->state == DECODER_BODY && dec->frame == NULL) {
+            // Corpo "in place": só o CRC avança, pelos dois pedaços do FIFO
+            RxSpan part;
+            size_t n = dec->header.msg_len - dec->have;
+            if (n > total - pos) n = total - pos;
+            span_slice(span, pos, n, &part);
+            crc32_stream_update(&dec->crc, part.data[0], part.len[0]);
+            crc32_stream_update(&dec->crc, part.data[1], part.len[1]);
+            dec->have += (uint32_t)n;
+            pos += n;
+            if (dec->have == dec->header.msg_len) dec->state = DECODER_VALIDATE;
+        } else if (dec->state == DECODER_VALIDATE) {
+            RxSpan body;
+            span_slice(span, body_start, pos - body_start, &body);
+            decoder_validate(dec, &body);
+            body_start = pos;
+        } else {
+            // Sync, cabeçalho ou descarte: bytes consumidos à medida
+            int seg = pos < span->len[0] ? 0 : 1;
+            size_t off = seg == 0 ? pos : pos - span->len[0];
+            pos += decoder_run(dec, span->data[seg] + off, span->len[seg] - off, 1);
+            body_start = pos;
+        }
+    }
+
+    // Enquanto o corpo do pacote em curso não estiver completo, fica no FIFO
+    return dec->state == DECODER_BODY && dec->frame == NULL ? body_start : total;
 }
 
 int FacePass_ExtractData(cJSON *json, int *score_out) {
@@ -249,51 +1411,279 @@ int FacePass_ExtractData(cJSON *json, int *score_out) {
     return id_found;
 }
 
+// --- EXTRAÇÃO DIRETA DOS EVENTOS DE RECONHECIMENTO ---
+// Uma passagem pelo corpo em bruto, sem árvore nem malloc: só se guardam as
+// chaves que FacePass_ExtractData consulta, na raiz e dentro de "iden_info".
+// As regras de prioridade são as mesmas (ver FacePass_ExtractData).
+
+enum { EV_TOP1_ID, EV_FACE_ID, EV_USER_ID, EV_ID, EV_IDEN_SCORE, EV_SCORE, EV_KEY_COUNT };
+static const char *const ev_keys[EV_KEY_COUNT] = { "top1_id", "face_id", "user_id", "id", "iden_score", "score" };
+static const uint8_t ev_key_len[EV_KEY_COUNT] = { 7, 7, 7, 2, 10, 5 };
+
+#define EV_PRESENT  1   // A chave existe (com qualquer tipo de valor)
+#define EV_NUMBER   2
+#define EV_STRING   4
+
+typedef struct {
+    uint8_t flags[EV_KEY_COUNT];
+    int value[EV_KEY_COUNT];
+} EventScope;
+
+// Percorre o objeto que começa em p ('{'); devolve o fim dele ou NULL se estiver
+// mal formado. Dentro da raiz, o primeiro "iden_info" passa a ser o alvo
+// (*has_inner = 1) e, se for um objeto, é lido para 'inner'; se for de outro
+// tipo o alvo fica vazio, tal como cJSON_GetObjectItem devolveria NULL nele.
+static const char *json_scan_event_object(const char *p, const char *end, EventScope *scope,
+                                          EventScope *inner, int *has_inner) {
+    p = json_skip_ws(p + 1, end);
+    if (p < end && *p == '}') return p + 1;
+
+    while (p < end) {
+        if (*p != '"') return NULL;
+        const char *key = p + 1;
+        p = json_skip_string(p, end);
+        if (p == NULL) return NULL;
+        size_t key_len = (size_t)(p - 1 - key);
+        p = json_skip_ws(p, end);
+        if (p == end || *p != ':') return NULL;
+        p = json_skip_ws(p + 1, end);
+        if (p == end) return NULL;
+
+        int k = 0;
+        while (k < EV_KEY_COUNT && !(ev_key_len[k] == key_len && memcmp(ev_keys[k], key, key_len) == 0)) k++;
+
+        const char *value_end;
+        if (inner != NULL && !*has_inner && key_len == 9 && memcmp(key, "iden_info", 9) == 0) {
+            *has_inner = 1;
+            if (*p == '{') value_end = json_scan_event_object(p, end, inner, NULL, NULL);
+            else value_end = json_skip_value(p, end);
+        } else {
+            value_end = json_skip_value(p, end);
+            if (k < EV_KEY_COUNT && !(scope->flags[k] & EV_PRESENT)) {
+                // Como o cJSON: vale a primeira ocorrência de cada chave
+                scope->flags[k] = EV_PRESENT;
+                if (*p == '"') {
+                    // atoi de uma string sem dígitos dá 0
+                    scope->flags[k] |= EV_STRING;
+                    if (!json_parse_int(p + 1, value_end, 1, &scope->value[k])) scope->value[k] = 0;
+                } else if (*p == '-' || (*p >= '0' && *p <= '9')) {
+                    scope->flags[k] |= EV_NUMBER;
+                    json_parse_int(p, value_end, 0, &scope->value[k]);
+                }
+            }
+        }
+        if (value_end == NULL) return NULL;
+
+        p = json_skip_ws(value_end, end);
+        if (p == end) return NULL;
+        if (*p == '}') return p + 1;
+        if (*p != ',') return NULL;
+        p = json_skip_ws(p + 1, end);
+    }
+    return NULL;
+}
+
+int FacePass_ExtractEvent(const char *body, size_t len, int *id_out, int *score_out) {
+    EventScope root, inner;
+    int has_inner = 0;
+    memset(&root, 0, sizeof(root));
+    memset(&inner, 0, sizeof(inner));
+    *id_out = -1;
+    if (score_out) *score_out = 0;
+
+    const char *end = body + len;
+    const char *p = json_skip_ws(body, end);
+    if (p == end || *p != '{' || json_scan_event_object(p, end, &root, &inner, &has_inner) == NULL) return 0;
+
+    const EventScope *target = has_inner ? &inner : &root;
+    for (int k = EV_TOP1_ID; k <= EV_ID; k++) {
+        if (target->flags[k] & (EV_NUMBER | EV_STRING)) *id_out = target->value[k];
+        if (*id_out != -1) break;
+    }
+    int s = (target->flags[EV_IDEN_SCORE] & EV_PRESENT) ? EV_IDEN_SCORE : EV_SCORE;
+    if ((target->flags[s] & EV_NUMBER) && score_out) *score_out = target->value[s];
+    return 1;
+}
+
 // --- IMPLEMENTAÇÃO DO BUFFER CIRCULAR (FIFO) ---
+// Ordem de memória: quem publica dados faz "release" depois do memcpy, e quem
+// lê o índice do outro lado faz "acquire" antes de tocar nos bytes.
 
 void rb_init(RingBuffer *rb, uint8_t *buffer, int capacity) {
+    uint32_t cap = 1;
+    while (cap <= (uint32_t)capacity / 2) cap <<= 1; // Maior potência de 2 <= capacity
     rb->data = buffer;
-    rb->capacity = capacity;
-    rb->head = 0;
-    rb->tail = 0;
-    rb->size = 0;
+    rb->capacity = cap;
+    rb->mask = cap - 1;
+    rb->mirrored = 0;
+    rb->map_handle = NULL;
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->dropped, 0);
+    atomic_init(&rb->tail, 0);
+}
+
+// Reserva 2*size de espaço de endereços e mapeia lá o mesmo objeto duas vezes.
+// Devolve o endereço base, ou NULL (o chamador usa então o FIFO normal).
+#ifdef _WIN32
+static uint8_t *rb_map_mirror(uint32_t size, void **handle) {
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, NULL);
+    if (mapping == NULL) return NULL;
+
+    // Sem VirtualAlloc2 não há forma atómica de reservar o sítio: encontra-se um
+    // buraco livre, larga-se e mapeia-se lá. Se outra thread o ocupar entretanto,
+    // tenta-se de novo.
+    for (int attempt = 0; attempt < 16; attempt++) {
+        uint8_t *base = (uint8_t*)VirtualAlloc(NULL, (SIZE_T)size * 2, MEM_RESERVE, PAGE_NOACCESS);
+        if (base == NULL) break;
+        VirtualFree(base, 0, MEM_RELEASE);
+
+        uint8_t *lo = (uint8_t*)MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, base);
+        if (lo == NULL) continue;
+        uint8_t *hi = (uint8_t*)MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, base + size);
+        if (hi == NULL) {
+            UnmapViewOfFile(lo);
+            continue;
+        }
+        *handle = mapping;
+        return base;
+    }
+    CloseHandle(mapping);
+    return NULL;
+}
+
+static void rb_unmap_mirror(uint8_t *base, uint32_t size, void *handle) {
+    UnmapViewOfFile(base + size);
+    UnmapViewOfFile(base);
+    CloseHandle((HANDLE)handle);
+}
+#else
+static uint8_t *rb_map_mirror(uint32_t size, void **handle) {
+    int fd = -1;
+#ifdef SYS_memfd_create
+    fd = (int)syscall(SYS_memfd_create, "protocol_rx_fifo", 0);
+#endif
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // Reserva o espaço todo primeiro, depois sobrepõe as duas vistas (MAP_FIXED)
+    uint8_t *base = (uint8_t*)mmap(NULL, (size_t)size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, (size_t)size * 2);
+        close(fd);
+        return NULL;
+    }
+    close(fd); // Os mapeamentos mantêm a memória viva
+    *handle = NULL;
+    return base;
+}
+
+static void rb_unmap_mirror(uint8_t *base, uint32_t size, void *handle) {
+    (void)handle;
+    munmap(base, (size_t)size * 2);
+}
+#endif
+
+int rb_init_mirrored(RingBuffer *rb, uint32_t capacity) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    uint32_t granularity = si.dwAllocationGranularity;
+#else
+    uint32_t granularity = (uint32_t)sysconf(_SC_PAGESIZE);
+#endif
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 || capacity % granularity != 0) return 0;
+
+    void *handle = NULL;
+    uint8_t *base = rb_map_mirror(capacity, &handle);
+    if (base == NULL) return 0;
+
+    rb_init(rb, base, (int)capacity);
+    rb->mirrored = 1;
+    rb->map_handle = handle;
+    return 1;
 }
 
-// Escreve dados na Cabeça (Head) do buffer
+void rb_destroy(RingBuffer *rb) {
+    if (rb->mirrored) rb_unmap_mirror(rb->data, rb->capacity, rb->map_handle);
+    rb->data = NULL;
+    rb->mirrored = 0;
+    rb->map_handle = NULL;
+}
+
+// Escreve dados na Cabeça (Head) do buffer (só a thread produtora)
 int rb_put(RingBuffer *rb, const uint8_t *src, int len) {
-    if (rb->size + len > rb->capacity) return 0; // Proteção contra Overflow
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    if ((uint32_t)len > rb->capacity - (head - tail)) { // Proteção contra Overflow
+        atomic_fetch_add_explicit(&rb->dropped, (unsigned)len, memory_order_relaxed);
+        return 0;
+    }
 
-    int space_until_end = rb->capacity - rb->head;
-    if (len <= space_until_end) {
-        // Cabe tudo até ao fim do array
-        memcpy(rb->data + rb->head, src, len);
+    uint32_t pos = head & rb->mask;
+    uint32_t space_until_end = rb->capacity - pos;
+    if (rb->mirrored || (uint32_t)len <= space_until_end) {
+        // Cabe tudo até ao fim do array (no espelhado, o "fim" continua no início)
+        memcpy(rb->data + pos, src, len);
     } else {
         // Dá a volta: copia uma parte para o fim, e o resto para o índice 0
-        memcpy(rb->data + rb->head, src, space_until_end);
+        memcpy(rb->data + pos, src, space_until_end);
         memcpy(rb->data, src + space_until_end, len - space_until_end);
     }
-    rb->head = (rb->head + len) % rb->capacity;
-    rb->size += len;
+    atomic_store_explicit(&rb->head, head + (uint32_t)len, memory_order_release);
     return len;
 }
 
+// Quantidade de bytes atualmente por ler (lado do consumidor)
+int rb_size(RingBuffer *rb) {
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    return (int)(head - tail);
+}
+
+// Dá acesso direto aos bytes por ler, sem os copiar nem apagar
+int rb_peek_span(RingBuffer *rb, RxSpan *span) {
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t size = atomic_load_explicit(&rb->head, memory_order_acquire) - tail;
+    uint32_t pos = tail & rb->mask;
+    uint32_t space_until_end = rb->mirrored ? size : rb->capacity - pos;
+    uint32_t first = size < space_until_end ? size : space_until_end;
+    span->data[0] = rb->data + pos;
+    span->len[0] = first;
+    span->data[1] = rb->data;
+    span->len[1] = size - first;
+    return (int)size;
+}
+
 // Lê os dados da Cauda (Tail) para um array linear (sem os apagar)
 int rb_peek(RingBuffer *rb, uint8_t *dst, int len) {
-    if (len > rb->size) len = rb->size; // Só lê o que existe
-    
-    int space_until_end = rb->capacity - rb->tail;
-    if (len <= space_until_end) {
-        memcpy(dst, rb->data + rb->tail, len);
-    } else {
-        memcpy(dst, rb->data + rb->tail, space_until_end);
-        memcpy(dst + space_until_end, rb->data, len - space_until_end);
-    }
+    RxSpan span;
+    int size = rb_peek_span(rb, &span);
+    if (len > size) len = size; // Só lê o que existe
+
+    size_t first = (size_t)len < span.len[0] ? (size_t)len : span.len[0];
+    memcpy(dst, span.data[0], first);
+    memcpy(dst + first, span.data[1], (size_t)len - first);
     return len;
 }
 
 // Avança a Cauda (Tail), efetivamente "apagando" os bytes lidos
 void rb_consume(RingBuffer *rb, int len) {
-    if (len > rb->size) len = rb->size;
-    rb->tail = (rb->tail + len) % rb->capacity;
-    rb->size -= len;
-}
\ No newline at end of file
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t size = atomic_load_explicit(&rb->head, memory_order_acquire) - tail;
+    if ((uint32_t)len > size) len = (int)size;
+    // "release": o produtor só reutiliza este espaço depois de o termos lido
+    atomic_store_explicit(&rb->tail, tail + (uint32_t)len, memory_order_release);
+}
+
+void rb_clear(RingBuffer *rb) {
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    atomic_store_explicit(&rb->tail, head, memory_order_release);
+}
@@ -3,10 +3,24 @@
 
 #include <stdint.h>
 #include <stddef.h>
-#include <windows.h>
+#include <stdatomic.h>
+#include "serial_transport.h"
 #include "cJSON.h"
+#include "buffer_pool.h"
 
 #define SYNC_FLAG_VALUE 0x0079CFEB
+#define PROTOCOL_MAX_MSG_LEN 400000
+
+// 1 = rejeita os pacotes recebidos com head_crc16 errado.
+// COMPATIBILIDADE: o calc_crc16 é o CRC-16/CCITT-FALSE (0x1021, início 0xFFFF)
+// sobre os bytes 12..19 do cabeçalho. O anterior dava quase sempre 0x0000; um
+// firmware que não preencha o campo, ou que use outra variante, teria TODOS os
+// pacotes rejeitados. Por isso fica a 0: o decoder confere na mesma e só conta
+// as diferenças em head_crc16_mismatches (avisa na primeira). Só passar a 1
+// depois de confirmar que o contador fica a 0 com o módulo real.
+#ifndef PROTOCOL_CHECK_HEAD_CRC16
+#define PROTOCOL_CHECK_HEAD_CRC16 0
+#endif
 
 #pragma pack(push, 1)
 typedef struct {
@@ -22,41 +36,231 @@ typedef struct {
 } ProtocolHeader;
 #pragma pack(pop)
 
+// --- CRC16 ---
+// head_crc16 (CCITT) sobre os bytes 12..19 do cabeçalho
+uint16_t calc_crc16(const uint8_t *data, size_t length);
+
+// --- CRC32 ---
+// msg_crc32 (polinómio refletido 0xEDB88320) com a versão mais rápida que o CPU suporta
+uint32_t calc_crc32(const uint8_t *data, size_t length);
+// O mesmo valor só com as tabelas slice-by-8 (referência para testes e benchmark)
+uint32_t calc_crc32_portable(const uint8_t *data, size_t length);
+
+// --- CRC32 INCREMENTAL (STREAMING) ---
+// Permite calcular o msg_crc32 aos bocados, à medida que os bytes chegam,
+// em vez de re-hashear o pacote inteiro quando ele fica completo.
+typedef struct {
+    uint32_t state;     // Registo interno do CRC (sem a inversão final)
+    uint32_t length;    // Quantos bytes já foram processados
+} Crc32Stream;
+
+void crc32_stream_init(Crc32Stream *s);
+void crc32_stream_update(Crc32Stream *s, const uint8_t *data, size_t len);
+uint32_t crc32_stream_final(const Crc32Stream *s);
+
+// --- BASE64 EM STREAMING ---
+// Descodifica aos bocados e entrega os bytes a um "sink" (ficheiro, região
+// mapeada, buffer do pool...), com uma janela fixa: nunca há uma cópia inteira
+// do resultado em memória. Mesmas regras estritas que base64_decode_into.
+#define BASE64_STREAM_WINDOW 4096   // Caracteres descodificados por passo
+
+// Recebe cada pedaço descodificado; devolve 0 para abortar (ex.: disco cheio)
+typedef int (*Base64Sink)(const uint8_t *data, size_t len, void *user);
+
+typedef struct {
+    Base64Sink sink;
+    void *user;
+    uint8_t pending[4];        // Grupo incompleto que ficou do pedaço anterior
+    int pending_len;
+    int done;                  // Já passou o grupo com '=' (nada mais pode vir)
+    int error;
+    uint64_t total_out;
+    uint8_t out[BASE64_STREAM_WINDOW / 4 * 3];
+} Base64Stream;
+
+void base64_stream_init(Base64Stream *s, Base64Sink sink, void *user);
+// Devolve 0 (e fica em erro) se os dados forem inválidos ou o sink falhar
+int base64_stream_feed(Base64Stream *s, const char *data, size_t len);
+// Fim da string: devolve 0 se ficou um grupo a meio ou houve erro antes
+int base64_stream_finish(Base64Stream *s);
+
+// Sinks prontos: ficheiro (user = FILE*) e memória (user = Base64MemSink*)
+int base64_sink_file(const uint8_t *data, size_t len, void *user);
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+    size_t len;
+} Base64MemSink;
+int base64_sink_memory(const uint8_t *data, size_t len, void *user);
+
 // --- ESTRUTURA DO BUFFER CIRCULAR (FIFO) ---
+// Fila sem cadeados para um único produtor (a thread de leitura, rb_put) e um
+// único consumidor (o main.c, rb_peek/rb_peek_span/rb_consume/rb_clear).
+// head e tail são contadores que só crescem (o índice real é contador & mask)
+// e cada um vive na sua linha de cache, para as duas threads não se atropelarem.
+#define RB_CACHE_LINE 64
+
 typedef struct {
-    uint8_t *data;      // Ponteiro para o array na memória
-    int capacity;       // Tamanho total do array
-    int head;           // Índice de ESCRITA (onde entram os novos dados)
-    int tail;           // Índice de LEITURA (onde saem os dados antigos)
-    int size;           // Quantidade de bytes atualmente por ler
+    uint8_t *data;                               // Ponteiro para o array na memória
+    uint32_t capacity;                           // Tamanho total do array (potência de 2)
+    uint32_t mask;                               // capacity - 1
+    int mirrored;                                // 1 = páginas mapeadas duas vezes (rb_init_mirrored)
+    void *map_handle;                            // Objeto de mapeamento (só no modo espelhado)
+
+    _Alignas(RB_CACHE_LINE) atomic_uint head;    // Total ESCRITO (só o produtor altera)
+    atomic_uint dropped;                         // Bytes perdidos por falta de espaço
+
+    _Alignas(RB_CACHE_LINE) atomic_uint tail;    // Total LIDO (só o consumidor altera)
 } RingBuffer;
 
+// Zona legível do FIFO sem cópia: no máximo dois pedaços contíguos
+// (do tail até ao fim do array e, se der a volta, do índice 0 em diante).
+// Num FIFO espelhado o segundo pedaço vem sempre vazio.
+typedef struct {
+    const uint8_t *data[2];
+    size_t len[2];
+} RxSpan;
+
+// A capacidade é arredondada para baixo até uma potência de 2
 void rb_init(RingBuffer *rb, uint8_t *buffer, int capacity);
+// FIFO espelhado: as mesmas páginas físicas ficam mapeadas duas vezes seguidas,
+// logo qualquer zona legível é um só ponteiro, mesmo quando dá a volta ao fim.
+// 'capacity' tem de ser potência de 2 e múltiplo da granularidade de mapeamento
+// (64 KB no Windows). Devolve 0 se o SO recusar: usar então rb_init.
+int rb_init_mirrored(RingBuffer *rb, uint32_t capacity);
+// Liberta o mapeamento de rb_init_mirrored (não faz nada num FIFO normal)
+void rb_destroy(RingBuffer *rb);
 int rb_put(RingBuffer *rb, const uint8_t *src, int len);
+int rb_size(RingBuffer *rb);
 int rb_peek(RingBuffer *rb, uint8_t *dst, int len);
+int rb_peek_span(RingBuffer *rb, RxSpan *span);
 void rb_consume(RingBuffer *rb, int len);
+// Descarta tudo o que está por ler (lado do consumidor; seguro com o produtor ativo)
+void rb_clear(RingBuffer *rb);
 
 // --- NOVA ESTRUTURA PARA PACOTES VALIDADOS ---
+// A URI e o BODY são "views" (ponteiro + tamanho) para dentro do buffer onde o
+// pacote foi recebido: nada é copiado. O BODY NÃO termina em '\0'.
 typedef struct {
     int is_valid;            // 1 se temos um pacote perfeito, 0 se não
     int bytes_to_consume;    // Quantos bytes o main.c deve apagar do buffer (limpar lixo ou pacote lido)
-    char uri[128];           // A rota do comando (ex: "/api/push/recog_result")
-    char body[80000];        // O corpo em JSON ou Base64
+    const char *uri;         // A rota do comando (ex: "/api/push/recog_result")
+    uint32_t uri_len;        // Tamanho da URI (sem o '\0' final)
+    const char *body;        // O corpo em JSON ou Base64
+    uint32_t body_len;       // Tamanho do corpo
     uint8_t type;            // 0: Request, 1: Response, 2: Evento (Reconhecimento)
     uint16_t serial;         // ID da mensagem
+    PoolBuffer *buffer;      // Buffer do pool que guarda o pacote (NULL = buffer do chamador)
 } ParsedPacket;
 
+// Liberta o pacote quando já não é preciso; a partir daí as views deixam de ser válidas
+void protocol_packet_release(ParsedPacket *pkt);
+
+// Verifica se a URI do pacote contém o texto indicado (equivalente ao strstr)
+int protocol_uri_contains(const ParsedPacket *pkt, const char *text);
+
+// --- DESCODIFICADOR INCREMENTAL (MÁQUINA DE ESTADOS) ---
+// Recebe os bytes aos bocados, à medida que chegam, e nunca volta a ler um byte
+// já processado: o trabalho por byte é constante, seja qual for o tamanho do pacote.
+typedef enum {
+    DECODER_HUNT_SYNC,   // À procura do SYNC_FLAG
+    DECODER_HEADER,      // A juntar os 20 bytes do cabeçalho
+    DECODER_BODY,        // A receber URI + BODY (CRC32 calculado à medida)
+    DECODER_SKIP,        // Pacote válido mas maior que o buffer: deita fora o resto
+    DECODER_VALIDATE     // Pacote completo, falta comparar o CRC32 e entregar
+} DecoderState;
+
+// Invocada uma vez por cada pacote válido. O pacote vem num buffer do pool e o
+// callback fica dono dele: pode guardá-lo, mas tem de chamar protocol_packet_release.
+typedef void (*PacketCallback)(ParsedPacket *pkt, void *user);
+
+typedef struct {
+    DecoderState state;
+    uint8_t head[sizeof(ProtocolHeader)];  // SYNC + cabeçalho, antes de se saber o tamanho
+    PoolBuffer *frame;         // Buffer do pool onde o pacote em curso é montado
+    uint32_t have;             // Bytes do pacote em curso já recebidos
+    ProtocolHeader header;     // Cópia do cabeçalho validado
+    Crc32Stream crc;
+    PacketCallback on_packet;
+    void *user;
+
+    // Estatísticas
+    uint32_t frames_ok;
+    uint32_t header_errors;
+    uint32_t crc_errors;
+    uint32_t head_crc16_mismatches; // Cabeçalhos com head_crc16 diferente do calc_crc16
+    uint32_t oversized;        // Pacotes descartados por falta de buffer
+    uint32_t bytes_discarded;
+} ProtocolDecoder;
+
+void protocol_decoder_init(ProtocolDecoder *dec, PacketCallback on_packet, void *user);
+void protocol_decoder_set_callback(ProtocolDecoder *dec, PacketCallback on_packet, void *user);
+void protocol_decoder_reset(ProtocolDecoder *dec);
+// Copia cada pacote para um buffer do pool à medida que os bytes chegam.
+// Um decoder usa sempre o mesmo modo: protocol_decoder_feed OU
+// protocol_decoder_feed_span, nunca os dois. Um pacote a meio quando se muda de
+// modo é descartado (bytes_discarded) e o decoder volta a procurar o SYNC.
+void protocol_decoder_feed(ProtocolDecoder *dec, const uint8_t *data, size_t len);
+
+// Descodifica diretamente da zona legível do FIFO, sem a achatar num buffer.
+// O corpo do pacote em curso fica no FIFO até estar completo (o CRC é calculado
+// no lugar) e só um pacote validado é copiado para um buffer do pool.
+// Devolve quantos bytes o chamador deve consumir (rb_consume); o FIFO tem de
+// conseguir guardar um pacote inteiro (PROTOCOL_MAX_MSG_LEN).
+size_t protocol_decoder_feed_span(ProtocolDecoder *dec, const RxSpan *span);
+
 // --- FUNÇÕES ---
-int protocol_send_msg(HANDLE hSerial, const char* uri, const char* body, uint16_t seq);
+int protocol_send_msg(SerialHandle hSerial, const char* uri, const char* body, uint16_t seq);
+// Preenche o cabeçalho de um pedido (need_resp = 1) com os dois CRCs, sem copiar
+// URI nem BODY. Devolve 0 se a URI ou o pacote excederem os limites.
+int protocol_build_header(ProtocolHeader *h, const char *uri, const uint8_t *body, uint32_t body_len, uint16_t seq);
+
+// CRC parcial do pacote que está a chegar no início do buffer de um chamador
+// (um por porta/buffer: nada é partilhado entre chamadas de buffers diferentes)
+typedef struct {
+    int active;
+    ProtocolHeader header;     // Pacote a que o CRC parcial pertence
+    Crc32Stream crc;
+} ProtocolParseState;
 
 // Nova função: Inspeciona o buffer bruto e devolve um pacote validado se existir
-ParsedPacket protocol_parse_buffer(const uint8_t *buffer, int current_len);
+// (as views do pacote apontam para dentro de 'buffer'). Com 'st' o CRC32 vai sendo
+// calculado à medida que o pacote chega; com NULL é calculado de uma vez no fim.
+ParsedPacket protocol_parse_buffer(ProtocolParseState *st, const uint8_t *buffer, int current_len);
+
+// Verifica só o cabeçalho (tamanhos coerentes e head_crc16), sem precisar do corpo
+int protocol_header_is_valid(const ProtocolHeader *h);
+
+// Esquece o CRC parcial do pacote em curso (chamar sempre que o buffer de receção for limpo)
+void protocol_parse_reset(ProtocolParseState *st);
 
 // (Mantenha as declarações do base64, crc32, extract_int_safe...)
 char* base64_encode(const unsigned char *data, size_t input_length, size_t *output_length);
+// Caracteres que 'input_length' bytes dão (com '=')
+size_t base64_encoded_length(size_t input_length);
+// Codifica para um buffer do chamador (ex.: o BODY de um pacote), sem '\0' no
+// fim. Devolve os caracteres escritos, ou 0 se não couber em 'out_capacity'.
+size_t base64_encode_into(const unsigned char *data, size_t input_length, char *out, size_t out_capacity);
 unsigned char* base64_decode(const char *data, size_t input_length, size_t *output_length);
+// Bytes que a string vai dar (0 se o tamanho não for múltiplo de 4)
+size_t base64_decoded_length(const char *data, size_t input_length);
+// Descodifica para um buffer do chamador. Devolve 0 se a string for inválida ou
+// não couber em 'out_capacity' (o conteúdo de 'out' fica indefinido).
+int base64_decode_into(const char *data, size_t input_length, unsigned char *out, size_t out_capacity,
+                       size_t *output_length);
 int find_pattern_index(const uint8_t *buffer, int buffer_len, const char *pattern);
 int extract_int_safe(const uint8_t *buffer, int len, const char *key);
+// Leitura direta de um campo "chave": valor no corpo JSON em bruto, sem árvore
+// nem cópias. Só conta a chave no objeto raiz (a primeira, como no cJSON).
+// A string devolvida é uma view para dentro do corpo, sem tratar escapes.
+// Devolvem 0 se a chave não existir ou o valor não for do tipo pedido.
+int protocol_json_find_int(const char *body, size_t len, const char *key, int *out);
+int protocol_json_find_string(const char *body, size_t len, const char *key, const char **value, size_t *value_len);
 int FacePass_ExtractData(cJSON *json, int *score_out);
+// Mesmo resultado que FacePass_ExtractData, mas lido direto do corpo em bruto
+// numa só passagem, sem cJSON nem memória alocada. Devolve 0 se o corpo não
+// tiver a estrutura de um objeto JSON (aí *id_out = -1); o ID vai para *id_out.
+// Os literais e números não são validados a fundo como no cJSON.
+int FacePass_ExtractEvent(const char *body, size_t len, int *id_out, int *score_out);
 
 #endif // PROTOCOL_MSG_H
\ No newline at end of file
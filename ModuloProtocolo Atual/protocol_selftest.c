@@ -0,0 +1,476 @@
+#ifndef _WIN32 // Só POSIX, como o serial_pty_test.c
+#define _DEFAULT_SOURCE
+// --- AUTOTESTES E BENCHMARKS DO PROTOCOLO ---
+// Confere as versões rápidas (CRC, procura do SYNC, FIFO, Base64, leitura dos
+// eventos) contra as versões anteriores, copiadas para aqui, e imprime o débito
+// de cada uma. Não precisa do módulo nem de uma porta série.
+// Programa à parte (tem o seu main):
+//   gcc -O2 -std=c11 -I. protocol_selftest.c serial_transport_posix.c protocol_msg.c buffer_pool.c
+//       platform.c cJSON.c -lpthread -lm -o protocol_selftest
+// Sai com 0 se tudo passou.
+#include "protocol_msg.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("  %-52s %s\n", what, ok ? "OK" : "[ERRO]");
+    if (!ok) failures++;
+}
+
+// --- BENCHMARK DO CRC32 ---
+// Cópia do calc_crc32 anterior (8 voltas por byte), só para comparação
+static uint32_t crc32_bitwise(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            if (crc & 1) crc = (crc >> 1) ^ 0xEDB88320;
+            else crc >>= 1;
+        }
+    }
+    return ~crc;
+}
+
+static void crc32_benchmark(void) {
+    const size_t len = 80 * 1024; // Resposta de cadastro com o 'ft'
+    const int rounds = 500;
+    uint8_t *buf = (uint8_t*)malloc(len);
+    if (buf == NULL) {
+        check(0, "memoria para o CRC32");
+        return;
+    }
+    for (size_t i = 0; i < len; i++) buf[i] = (uint8_t)(rand() & 0xFF);
+
+    // Todos os tamanhos até 1 KB e todos os desalinhamentos até 16
+    int mismatches = 0;
+    for (size_t n = 0; n <= 1024; n++) {
+        for (size_t off = 0; off < 16; off++) {
+            uint32_t ref = crc32_bitwise(buf + off, n);
+            if (calc_crc32_portable(buf + off, n) != ref || calc_crc32(buf + off, n) != ref) mismatches++;
+        }
+    }
+    if (calc_crc32(buf, len) != crc32_bitwise(buf, len)) mismatches++;
+
+    printf("\nCRC32 (%u bytes, %d vezes):\n", (unsigned)len, rounds);
+    check(mismatches == 0, "slice-by-8 e calc_crc32 iguais ao bit-a-bit");
+
+    volatile uint32_t sink = 0;
+    uint64_t t0 = os_now_us();
+    for (int r = 0; r < rounds / 10; r++) sink ^= crc32_bitwise(buf, len); // Lento: menos voltas
+    uint64_t t_bitwise = (os_now_us() - t0) * 10;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) sink ^= calc_crc32_portable(buf, len);
+    uint64_t t_slice8 = os_now_us() - t0;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) sink ^= calc_crc32(buf, len);
+    uint64_t t_calc = os_now_us() - t0;
+    (void)sink;
+
+    double bytes = (double)len * rounds; // bytes por us = MB/s
+    printf("  bit-a-bit (anterior): %8.0f MB/s\n", bytes / (double)(t_bitwise ? t_bitwise : 1));
+    printf("  slice-by-8          : %8.0f MB/s\n", bytes / (double)(t_slice8 ? t_slice8 : 1));
+    printf("  calc_crc32          : %8.0f MB/s\n", bytes / (double)(t_calc ? t_calc : 1));
+    free(buf);
+}
+
+// --- AUTOTESTE DO CRC32 ACELERADO ---
+// calc_crc32 (PCLMULQDQ, se o CPU tiver) contra a versão escalar em tamanhos
+// aleatórios de 0 a PROTOCOL_MAX_MSG_LEN
+#define CRC_SELFTEST_ROUNDS 300
+
+static void crc_selftest(void) {
+    // +16 para também variar o alinhamento do início
+    uint8_t *buf = (uint8_t*)malloc(PROTOCOL_MAX_MSG_LEN + 16);
+    if (buf == NULL) {
+        check(0, "memoria para o autoteste do CRC32");
+        return;
+    }
+    for (size_t i = 0; i < PROTOCOL_MAX_MSG_LEN + 16; i++) buf[i] = (uint8_t)(rand() & 0xFF);
+
+    int failed = 0;
+    for (int r = 0; r < CRC_SELFTEST_ROUNDS; r++) {
+        // rand() pode ter só 15 bits: junta dois para cobrir os 400000
+        size_t n = (((size_t)rand() << 15) ^ (size_t)rand()) % (PROTOCOL_MAX_MSG_LEN + 1);
+        if (r < 64) n = (size_t)r; // Os tamanhos pequenos só passam pela cauda
+        size_t off = (size_t)(rand() & 15);
+        uint32_t ref = calc_crc32_portable(buf + off, n);
+
+        // Inteiro e aos bocados (como o decoder), os dois têm de dar o mesmo
+        Crc32Stream s;
+        size_t cut = n ? (size_t)rand() % n : 0;
+        crc32_stream_init(&s);
+        crc32_stream_update(&s, buf + off, cut);
+        crc32_stream_update(&s, buf + off + cut, n - cut);
+
+        if (calc_crc32(buf + off, n) != ref || crc32_stream_final(&s) != ref) {
+            if (failed++ < 5) printf("  CRC32 diferente: %u bytes a partir de +%u\n", (unsigned)n, (unsigned)off);
+        }
+    }
+    printf("\nCRC32 acelerado contra escalar (%d tamanhos):\n", CRC_SELFTEST_ROUNDS);
+    check(failed == 0, "calc_crc32 e Crc32Stream iguais ao escalar");
+    free(buf);
+}
+
+// --- BENCHMARK DA PROCURA DO SYNC ---
+// Procura do SYNC_FLAG e find_pattern_index num buffer de 200 KB de ruído,
+// contra os ciclos byte a byte anteriores
+// Cópias da procura anterior: um uint32_t desalinhado em cada posição e um
+// memcmp em cada ocorrência do primeiro byte
+static int sync_scan_legacy(const uint8_t *buffer, int current_len) {
+    for (int i = 0; i <= current_len - 4; i++) {
+        uint32_t flag;
+        memcpy(&flag, buffer + i, 4);
+        if (flag == SYNC_FLAG_VALUE) return i;
+    }
+    return -1;
+}
+
+static int find_pattern_legacy(const uint8_t *buffer, int buffer_len, const char *pattern) {
+    int pattern_len = (int)strlen(pattern);
+    if (buffer_len < pattern_len) return -1;
+    for (int i = 0; i <= buffer_len - pattern_len; i++) {
+        if (buffer[i] == pattern[0] && memcmp(buffer + i, pattern, pattern_len) == 0) return i;
+    }
+    return -1;
+}
+
+static void sync_scan_benchmark(void) {
+    const int len = 200 * 1024;
+    const int rounds = 2000;
+    static const char key[] = "\"iden_score\"";
+    const uint32_t sync = SYNC_FLAG_VALUE;
+    uint8_t *noise = (uint8_t*)malloc((size_t)len);
+    if (noise == NULL) {
+        check(0, "memoria para a procura do SYNC");
+        return;
+    }
+
+    // Ruído sem nenhum SYNC nem chave por acaso; o alvo fica no fim, como numa
+    // ressincronização depois de uma rajada de lixo
+    for (int i = 0; i < len; i++) noise[i] = (uint8_t)(rand() & 0xFF);
+    for (int i = 0; i <= len - 4; i++) if (memcmp(noise + i, &sync, 4) == 0) noise[i] ^= 0x55;
+    memcpy(noise + len - 4, &sync, 4);
+
+    volatile int sink = 0;
+    int expect = len - 4, ok = 1;
+    uint64_t t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) sink += sync_scan_legacy(noise, len);
+    uint64_t t_legacy = os_now_us() - t0;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) {
+        ParsedPacket pkt = protocol_parse_buffer(NULL, noise, len); // Manda consumir o lixo até ao SYNC
+        ok &= pkt.bytes_to_consume == expect;
+    }
+    uint64_t t_scan = os_now_us() - t0;
+
+    double bytes = (double)len * rounds; // bytes por us = MB/s
+    printf("\nProcura do SYNC_FLAG (%d KB de ruido, %d vezes):\n", len / 1024, rounds);
+    printf("  SYNC anterior          : %6.0f MB/s\n", bytes / (double)(t_legacy ? t_legacy : 1));
+    printf("  protocol_parse_buffer  : %6.0f MB/s\n", bytes / (double)(t_scan ? t_scan : 1));
+    check(ok, "protocol_parse_buffer para no SYNC do fim");
+
+    // find_pattern_index: mesma ideia com uma chave de texto no fim
+    memcpy(noise + len - 4, "xxxx", 4);
+    expect = len - (int)strlen(key);
+    memcpy(noise + expect, key, strlen(key));
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) sink += find_pattern_legacy(noise, len, key);
+    t_legacy = os_now_us() - t0;
+
+    ok = 1;
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) ok &= find_pattern_index(noise, len, key) == expect;
+    t_scan = os_now_us() - t0;
+    (void)sink;
+
+    printf("  find_pattern anterior  : %6.0f MB/s\n", bytes / (double)(t_legacy ? t_legacy : 1));
+    printf("  find_pattern_index     : %6.0f MB/s\n", bytes / (double)(t_scan ? t_scan : 1));
+    check(ok, "find_pattern_index encontra a chave do fim");
+    free(noise);
+}
+
+// --- TESTE DE STRESS DO FIFO ---
+// Uma thread escreve e outra lê o FIFO sem parar; cada byte é conferido
+// (FIFO normal e espelhado)
+#define RB_STRESS_BYTES (64u * 1024 * 1024)
+#define RB_STRESS_CAPACITY (64 * 1024) // Pequeno de propósito: dá a volta muitas vezes
+
+// Byte 'k' do fluxo: muda a cada posição e a cada volta, para apanhar bytes
+// trocados, repetidos ou perdidos
+static uint8_t rb_stress_byte(uint32_t k) {
+    return (uint8_t)(k ^ (k >> 8) ^ (k >> 16) ^ (k >> 24));
+}
+
+typedef struct {
+    RingBuffer *rb;
+    uint32_t full_retries;  // rb_put recusados por o FIFO estar cheio
+} RbStressProducer;
+
+// Thread produtora: blocos de 1..4096 bytes, como as leituras da serial
+static void rb_stress_producer(void *arg) {
+    RbStressProducer *p = (RbStressProducer*)arg;
+    uint8_t chunk[4096];
+    uint32_t k = 0, seed = 12345;
+    while (k < RB_STRESS_BYTES) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t n = 1 + (seed >> 16) % sizeof(chunk);
+        if (n > RB_STRESS_BYTES - k) n = RB_STRESS_BYTES - k;
+        for (uint32_t i = 0; i < n; i++) chunk[i] = rb_stress_byte(k + i);
+        while (rb_put(p->rb, chunk, (int)n) == 0) { // Nunca bloqueia: cede e tenta outra vez
+            p->full_retries++;
+            os_thread_yield();
+        }
+        k += n;
+    }
+}
+
+static void rb_stress_run(RingBuffer *rb, const char *name) {
+    RbStressProducer prod = { rb, 0 };
+    OsThread thread;
+    uint32_t k = 0, errors = 0, seed = 777;
+
+    uint64_t t0 = os_now_us();
+    if (!os_thread_start(&thread, rb_stress_producer, &prod)) {
+        check(0, "arrancar a thread produtora");
+        return;
+    }
+    // Esta thread é o consumidor: lê direto dos pedaços e consome quantidades aleatórias
+    while (k < RB_STRESS_BYTES) {
+        RxSpan span;
+        if (rb_peek_span(rb, &span) == 0) {
+            os_thread_yield();
+            continue;
+        }
+        seed = seed * 1103515245u + 12345u;
+        size_t want = 1 + (seed >> 16) % 8192;
+        size_t used = 0;
+        for (int s = 0; s < 2 && used < want; s++) {
+            for (size_t i = 0; i < span.len[s] && used < want; i++, used++) {
+                if (span.data[s][i] != rb_stress_byte(k + (uint32_t)used)) errors++;
+            }
+        }
+        rb_consume(rb, (int)used);
+        k += (uint32_t)used;
+    }
+    os_thread_join(&thread);
+    uint64_t elapsed = os_now_us() - t0;
+
+    printf("  %-9s: %6.0f MB/s, %u bytes errados, %u vezes cheio, sobra %d\n", name,
+           (double)RB_STRESS_BYTES / (double)(elapsed ? elapsed : 1), errors, prod.full_retries,
+           rb_size(rb));
+    check(errors == 0 && rb_size(rb) == 0, "todos os bytes por ordem e FIFO vazio no fim");
+}
+
+static void rb_stress_benchmark(void) {
+    static uint8_t memory[RB_STRESS_CAPACITY];
+    RingBuffer rb;
+
+    printf("\nFIFO com 2 threads (%u MB, %d KB de capacidade):\n", RB_STRESS_BYTES >> 20, RB_STRESS_CAPACITY / 1024);
+    rb_init(&rb, memory, RB_STRESS_CAPACITY);
+    rb_stress_run(&rb, "normal");
+    if (rb_init_mirrored(&rb, RB_STRESS_CAPACITY)) {
+        rb_stress_run(&rb, "espelhado");
+        rb_destroy(&rb);
+    }
+}
+
+// --- BENCHMARK DO BASE64 ---
+// Cópia do descodificador anterior (tabela refeita a cada chamada, um sexteto de
+// cada vez, sem validação), só para comparação
+static unsigned char *base64_decode_legacy(const char *data, size_t input_length, size_t *output_length) {
+    static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (input_length % 4 != 0) return NULL;
+    *output_length = input_length / 4 * 3;
+    if (data[input_length - 1] == '=') (*output_length)--;
+    if (data[input_length - 2] == '=') (*output_length)--;
+
+    unsigned char *decoded_data = (unsigned char *)malloc(*output_length);
+    if (decoded_data == NULL) return NULL;
+
+    int decoding_table[256];
+    for (int i = 0; i < 256; i++) decoding_table[i] = -1;
+    for (int i = 0; i < 64; i++) decoding_table[(unsigned char)b64_table[i]] = i;
+
+    for (size_t i = 0, j = 0; i < input_length;) {
+        uint32_t sextet_a = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
+        uint32_t sextet_b = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
+        uint32_t sextet_c = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
+        uint32_t sextet_d = data[i] == '=' ? 0 & i++ : decoding_table[(unsigned char)data[i++]];
+        uint32_t triple = (sextet_a << 3 * 6) + (sextet_b << 2 * 6) + (sextet_c << 1 * 6) + (sextet_d << 0 * 6);
+
+        if (j < *output_length) decoded_data[j++] = (triple >> 2 * 8) & 0xFF;
+        if (j < *output_length) decoded_data[j++] = (triple >> 1 * 8) & 0xFF;
+        if (j < *output_length) decoded_data[j++] = (triple >> 0 * 8) & 0xFF;
+    }
+    return decoded_data;
+}
+
+// Cópia do codificador anterior (malloc por chamada, um grupo de 3 bytes por volta)
+static char *base64_encode_legacy(const unsigned char *data, size_t input_length, size_t *output_length) {
+    static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const int mod_table[] = {0, 2, 1};
+    *output_length = 4 * ((input_length + 2) / 3);
+    char *encoded_data = (char *)malloc(*output_length + 1);
+    if (encoded_data == NULL) return NULL;
+
+    for (size_t i = 0, j = 0; i < input_length;) {
+        uint32_t octet_a = i < input_length ? (unsigned char)data[i++] : 0;
+        uint32_t octet_b = i < input_length ? (unsigned char)data[i++] : 0;
+        uint32_t octet_c = i < input_length ? (unsigned char)data[i++] : 0;
+        uint32_t triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
+
+        encoded_data[j++] = b64_table[(triple >> 3 * 6) & 0x3F];
+        encoded_data[j++] = b64_table[(triple >> 2 * 6) & 0x3F];
+        encoded_data[j++] = b64_table[(triple >> 1 * 6) & 0x3F];
+        encoded_data[j++] = b64_table[(triple >> 0 * 6) & 0x3F];
+    }
+    for (int i = 0; i < mod_table[input_length % 3]; i++)
+        encoded_data[*output_length - 1 - i] = '=';
+
+    encoded_data[*output_length] = '\0';
+    return encoded_data;
+}
+
+static void base64_encode_benchmark(void) {
+    const size_t raw_len = 60000; // Feature de um face_*.bin
+    const int rounds = 2000;
+    unsigned char *raw = (unsigned char*)malloc(raw_len);
+    size_t ref_len = 0, n = 0;
+    char *ref = NULL, *enc_out = NULL;
+    if (raw != NULL) {
+        for (size_t i = 0; i < raw_len; i++) raw[i] = (unsigned char)(rand() & 0xFF);
+        ref = base64_encode_legacy(raw, raw_len, &ref_len); // O resultado tem de ser igual ao anterior
+        enc_out = (char*)malloc(base64_encoded_length(raw_len));
+    }
+    if (ref == NULL || enc_out == NULL) {
+        check(0, "memoria para o Base64");
+        free(enc_out); free(ref); free(raw);
+        return;
+    }
+
+    printf("\nBase64 codificar (%u bytes, %d vezes):\n", (unsigned)raw_len, rounds);
+    char *b64 = base64_encode(raw, raw_len, &n);
+    check(b64 != NULL && n == ref_len && memcmp(b64, ref, ref_len) == 0, "base64_encode igual ao anterior");
+    free(b64);
+
+    // 'raw_len' bytes de entrada por volta
+    uint64_t t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) free(base64_encode_legacy(raw, raw_len, &n));
+    uint64_t te_legacy = os_now_us() - t0;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) free(base64_encode(raw, raw_len, &n));
+    uint64_t te_alloc = os_now_us() - t0;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) n = base64_encode_into(raw, raw_len, enc_out, ref_len);
+    uint64_t te_into = os_now_us() - t0;
+
+    double enc_bytes = (double)raw_len * rounds / 1000.0;
+    printf("  anterior            : %6.2f GB/s\n", enc_bytes / (double)(te_legacy ? te_legacy : 1));
+    printf("  base64_encode       : %6.2f GB/s\n", enc_bytes / (double)(te_alloc ? te_alloc : 1));
+    printf("  base64_encode_into  : %6.2f GB/s\n", enc_bytes / (double)(te_into ? te_into : 1));
+    check(n == ref_len && memcmp(enc_out, ref, ref_len) == 0, "base64_encode_into igual ao anterior");
+    free(enc_out);
+    free(ref);
+    free(raw);
+}
+
+static void base64_decode_benchmark(void) {
+    const size_t raw_len = 60000; // 'ft' de ~80 KB em Base64
+    const int rounds = 2000;
+    unsigned char *raw = (unsigned char*)malloc(raw_len);
+    unsigned char *out = (unsigned char*)malloc(raw_len);
+    size_t b64_len = 0, n = 0;
+    char *b64 = NULL;
+    if (raw != NULL) {
+        for (size_t i = 0; i < raw_len; i++) raw[i] = (unsigned char)(rand() & 0xFF);
+        b64 = base64_encode(raw, raw_len, &b64_len);
+    }
+    if (out == NULL || b64 == NULL) {
+        check(0, "memoria para o Base64");
+        free(b64); free(raw); free(out);
+        return;
+    }
+
+    printf("\nBase64 descodificar (%u bytes, %d vezes):\n", (unsigned)b64_len, rounds);
+    unsigned char *dec = base64_decode(b64, b64_len, &n);
+    check(dec != NULL && n == raw_len && memcmp(dec, raw, raw_len) == 0, "base64_decode devolve os bytes originais");
+    free(dec);
+
+    // 'b64_len' caracteres de entrada por volta
+    uint64_t t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) free(base64_decode_legacy(b64, b64_len, &n));
+    uint64_t t_legacy = os_now_us() - t0;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) free(base64_decode(b64, b64_len, &n));
+    uint64_t t_alloc = os_now_us() - t0;
+
+    int ok = 1;
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) ok &= base64_decode_into(b64, b64_len, out, raw_len, &n);
+    uint64_t t_into = os_now_us() - t0;
+    ok &= n == raw_len && memcmp(out, raw, raw_len) == 0;
+
+    double bytes = (double)b64_len * rounds / 1000.0; // bytes por us = MB/s; /1000 => GB/s
+    printf("  anterior            : %6.2f GB/s\n", bytes / (double)(t_legacy ? t_legacy : 1));
+    printf("  base64_decode       : %6.2f GB/s\n", bytes / (double)(t_alloc ? t_alloc : 1));
+    printf("  base64_decode_into  : %6.2f GB/s\n", bytes / (double)(t_into ? t_into : 1));
+    check(ok, "base64_decode_into devolve os bytes originais");
+    free(b64);
+    free(raw);
+    free(out);
+}
+
+// --- BENCHMARK DOS EVENTOS DE RECONHECIMENTO ---
+// Eventos por segundo: cJSON + FacePass_ExtractData contra FacePass_ExtractEvent
+// (leitura direta do corpo)
+static void recog_extract_benchmark(void) {
+    static const char event[] =
+        "{\"err_info\": 0, \"push_type\": \"recog_result\", \"iden_info\": {\"top1_id\": 12, "
+        "\"iden_score\": 93, \"group_id\": 0, \"track_id\": 4471, \"liveness\": 1, \"name\": \"\"}, "
+        "\"rect\": {\"x\": 120, \"y\": 80, \"w\": 200, \"h\": 220}, \"time\": 1717171717}";
+    const size_t len = sizeof(event) - 1;
+    const int rounds = 200000;
+    int id_a = -1, score_a = 0, id_b = -1, score_b = 0;
+
+    uint64_t t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) {
+        cJSON *json = cJSON_ParseWithLength(event, len);
+        id_a = FacePass_ExtractData(json, &score_a);
+        cJSON_Delete(json);
+    }
+    uint64_t t_cjson = os_now_us() - t0;
+
+    t0 = os_now_us();
+    for (int r = 0; r < rounds; r++) FacePass_ExtractEvent(event, len, &id_b, &score_b);
+    uint64_t t_direct = os_now_us() - t0;
+
+    printf("\nEventos de reconhecimento (%d vezes):\n", rounds);
+    printf("  cJSON + ExtractData : %10.0f eventos/s\n", rounds * 1e6 / (double)(t_cjson ? t_cjson : 1));
+    printf("  FacePass_ExtractEvent: %9.0f eventos/s\n", rounds * 1e6 / (double)(t_direct ? t_direct : 1));
+    check(id_a == 12 && score_a == 93 && id_b == id_a && score_b == score_a, "ExtractEvent igual ao cJSON + ExtractData");
+}
+
+int main(void) {
+    srand(12345); // Sempre os mesmos dados: uma falha repete-se
+    crc_selftest();
+    crc32_benchmark();
+    sync_scan_benchmark();
+    rb_stress_benchmark();
+    base64_encode_benchmark();
+    base64_decode_benchmark();
+    recog_extract_benchmark();
+    printf("\n%s\n", failures ? "FALHOU" : "TUDO OK");
+    return failures ? 1 : 0;
+}
+
+#endif // _WIN32
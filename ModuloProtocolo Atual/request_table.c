@@ -0,0 +1,205 @@
+#include "request_table.h"
+#include <string.h>
+
+void request_table_init(RequestTable *t) {
+    memset(t, 0, sizeof(*t));
+    os_lock_init(&t->lock);
+}
+
+// Tira da tabela os pedidos fora de prazo (ou todos, com 'all') e só depois,
+// já sem o cadeado, chama os callbacks.
+static void request_table_flush(RequestTable *t, int all, RequestStatus status) {
+    PendingRequest done[REQUEST_TABLE_SIZE];
+    int n = 0;
+    uint32_t now = os_now_ms();
+
+    os_lock(&t->lock);
+    for (int i = 0; i < REQUEST_TABLE_SIZE; i++) {
+        PendingRequest *r = &t->slots[i];
+        if (!r->in_use) continue;
+        if (!all && now - r->sent_ms < r->timeout_ms) continue;
+        done[n++] = *r;
+        r->in_use = 0;
+        t->pending--;
+        if (status == REQ_TIMEOUT) t->timeouts++;
+    }
+    os_unlock(&t->lock);
+
+    for (int i = 0; i < n; i++) {
+        if (done[i].cb) done[i].cb(done[i].serial, status, NULL, done[i].user);
+    }
+}
+
+void request_table_cancel_all(RequestTable *t) {
+    request_table_flush(t, 1, REQ_CANCELLED);
+}
+
+void request_table_destroy(RequestTable *t) {
+    request_table_cancel_all(t);
+    os_lock_destroy(&t->lock);
+}
+
+// Regista o pedido ANTES de enviar: a resposta pode chegar antes de o envio voltar.
+// Devolve o slot, ou NULL se a tabela estiver cheia ou o serial já estiver em voo.
+static PendingRequest *request_register(RequestTable *t, uint16_t seq, uint32_t timeout_ms,
+                                        RequestCallback cb, void *user) {
+    PendingRequest *slot = NULL;
+
+    os_lock(&t->lock);
+    for (int i = 0; i < REQUEST_TABLE_SIZE && slot == NULL; i++) {
+        if (t->slots[i].in_use && t->slots[i].serial == seq) {
+            // Serial repetido ainda em voo: a resposta seria ambígua
+            os_unlock(&t->lock);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < REQUEST_TABLE_SIZE && slot == NULL; i++) {
+        if (!t->slots[i].in_use) slot = &t->slots[i];
+    }
+    if (slot == NULL) {
+        t->rejected_full++;
+        os_unlock(&t->lock);
+        return NULL;
+    }
+    slot->in_use = 1;
+    slot->serial = seq;
+    slot->sent_ms = os_now_ms();
+    slot->timeout_ms = timeout_ms;
+    slot->cb = cb;
+    slot->user = user;
+    t->pending++;
+    os_unlock(&t->lock);
+    return slot;
+}
+
+// O envio falhou: não há resposta a esperar
+static void request_unregister(RequestTable *t, PendingRequest *slot, uint16_t seq) {
+    os_lock(&t->lock);
+    if (slot->in_use && slot->serial == seq) {
+        slot->in_use = 0;
+        t->pending--;
+    }
+    os_unlock(&t->lock);
+}
+
+int request_send(RequestTable *t, SerialHandle hSerial, const char *uri, const char *body,
+                 uint16_t seq, uint32_t timeout_ms, RequestCallback cb, void *user) {
+    PendingRequest *slot = request_register(t, seq, timeout_ms, cb, user);
+    if (slot == NULL) return -1;
+
+    int written = protocol_send_msg(hSerial, uri, body, seq);
+    if (written < 0) request_unregister(t, slot, seq);
+    return written;
+}
+
+int request_send_queued(RequestTable *t, TxQueue *q, TxLane lane, const char *uri, const char *body,
+                        uint16_t seq, uint32_t timeout_ms, RequestCallback cb, void *user) {
+    PendingRequest *slot = request_register(t, seq, timeout_ms, cb, user);
+    if (slot == NULL) return -1;
+
+    // O BODY é copiado pela fila (sem callback): o chamador pode libertá-lo já
+    if (!tx_queue_send(q, lane, uri, (const uint8_t*)body, (uint32_t)strlen(body), seq, NULL, NULL)) {
+        request_unregister(t, slot, seq);
+        return -1;
+    }
+    return 0;
+}
+
+int request_table_watch(RequestTable *t, uint16_t seq, uint32_t timeout_ms, RequestCallback cb, void *user) {
+    return request_register(t, seq, timeout_ms, cb, user) != NULL ? 0 : -1;
+}
+
+int request_table_cancel(RequestTable *t, uint16_t seq) {
+    PendingRequest done;
+    int found = 0;
+
+    os_lock(&t->lock);
+    for (int i = 0; i < REQUEST_TABLE_SIZE; i++) {
+        PendingRequest *r = &t->slots[i];
+        if (r->in_use && r->serial == seq) {
+            done = *r;
+            r->in_use = 0;
+            t->pending--;
+            found = 1;
+            break;
+        }
+    }
+    os_unlock(&t->lock);
+
+    if (found && done.cb) done.cb(done.serial, REQ_CANCELLED, NULL, done.user);
+    return found;
+}
+
+int request_table_complete(RequestTable *t, ParsedPacket *pkt) {
+    PendingRequest done;
+    int found = 0;
+
+    // Só respostas (type 1): um evento ou pedido do módulo pode trazer um serial
+    // igual ao de um comando nosso e não o pode completar
+    if (pkt->type != 1) return 0;
+
+    os_lock(&t->lock);
+    if (t->pending > 0) {
+        for (int i = 0; i < REQUEST_TABLE_SIZE; i++) {
+            PendingRequest *r = &t->slots[i];
+            if (r->in_use && r->serial == pkt->serial) {
+                done = *r;
+                r->in_use = 0;
+                t->pending--;
+                t->completed++;
+                found = 1;
+                break;
+            }
+        }
+    }
+    os_unlock(&t->lock);
+
+    if (!found) return 0;
+    if (done.cb) done.cb(done.serial, REQ_OK, pkt, done.user);
+    else protocol_packet_release(pkt);
+    return 1;
+}
+
+void request_table_poll(RequestTable *t) {
+    request_table_flush(t, 0, REQ_TIMEOUT);
+}
+
+uint32_t request_table_next_deadline(RequestTable *t) {
+    uint32_t best = REQUEST_NO_DEADLINE;
+    uint32_t now = os_now_ms();
+
+    os_lock(&t->lock);
+    for (int i = 0; i < REQUEST_TABLE_SIZE; i++) {
+        PendingRequest *r = &t->slots[i];
+        if (!r->in_use) continue;
+        uint32_t elapsed = now - r->sent_ms;
+        uint32_t left = elapsed >= r->timeout_ms ? 0 : r->timeout_ms - elapsed;
+        if (left < best) best = left;
+    }
+    os_unlock(&t->lock);
+    return best;
+}
+
+int request_table_pending(RequestTable *t) {
+    os_lock(&t->lock);
+    int n = t->pending;
+    os_unlock(&t->lock);
+    return n;
+}
+
+void request_future_init(RequestFuture *f) {
+    memset(f, 0, sizeof(*f));
+    f->err = -1;
+}
+
+void request_future_cb(uint16_t serial, RequestStatus status, ParsedPacket *resp, void *user) {
+    RequestFuture *f = (RequestFuture*)user;
+    (void)serial;
+    f->status = status;
+    if (status == REQ_OK) {
+        // Só interessa o err_info: lido direto do corpo, sem árvore cJSON
+        protocol_json_find_int(resp->body, resp->body_len, "err_info", &f->err);
+        protocol_packet_release(resp);
+    }
+    f->done = 1;
+}
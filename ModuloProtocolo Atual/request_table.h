@@ -0,0 +1,87 @@
+#ifndef REQUEST_TABLE_H
+#define REQUEST_TABLE_H
+
+#include <stdint.h>
+#include "platform.h"
+#include "protocol_msg.h"
+#include "tx_queue.h"
+
+// --- PEDIDOS EM VOO (correlação pedido/resposta pelo 'serial') ---
+// Cada pedido enviado com need_resp = 1 fica registado com o seu serial e um
+// prazo. A resposta com o mesmo serial completa-o; passado o prazo completa
+// com REQ_TIMEOUT. Assim vários comandos independentes podem ir seguidos, sem
+// Sleep() fixos entre eles.
+#define REQUEST_TABLE_SIZE 32
+#define REQUEST_NO_DEADLINE 0xFFFFFFFFu
+
+typedef enum {
+    REQ_OK = 0,        // Chegou a resposta
+    REQ_TIMEOUT,       // Passou o prazo sem resposta
+    REQ_CANCELLED      // request_table_cancel_all (ex.: ao fechar a porta)
+} RequestStatus;
+
+// 'resp' só vem preenchido com REQ_OK e o callback é o dono dele
+// (protocol_packet_release), tal como no PacketCallback do decoder.
+typedef void (*RequestCallback)(uint16_t serial, RequestStatus status, ParsedPacket *resp, void *user);
+
+typedef struct {
+    int in_use;
+    uint16_t serial;
+    uint32_t sent_ms;          // os_now_ms() no envio
+    uint32_t timeout_ms;
+    RequestCallback cb;
+    void *user;
+} PendingRequest;
+
+typedef struct {
+    OsLock lock;               // Envios e respostas podem vir de threads diferentes
+    PendingRequest slots[REQUEST_TABLE_SIZE];
+    int pending;
+    uint32_t completed, timeouts, rejected_full;
+} RequestTable;
+
+// "Future" simples: usar request_future_cb com user = &future e ver 'done'
+typedef struct {
+    volatile int done;
+    RequestStatus status;
+    int err;                   // Campo "err_info" da resposta (-1 se não vier; 0 = sucesso)
+} RequestFuture;
+
+void request_table_init(RequestTable *t);
+// Completa com REQ_CANCELLED tudo o que ainda esteja pendente
+void request_table_cancel_all(RequestTable *t);
+void request_table_destroy(RequestTable *t);
+
+// Regista o pedido e envia-o. Devolve o resultado de protocol_send_msg, ou -1 se
+// a tabela estiver cheia ou o envio falhar (nesse caso o callback não é chamado).
+int request_send(RequestTable *t, SerialHandle hSerial, const char *uri, const char *body,
+                 uint16_t seq, uint32_t timeout_ms, RequestCallback cb, void *user);
+// Igual, mas o pacote vai para a faixa 'lane' da fila de envio da porta em vez
+// de ser escrito já. Devolve 0 se ficou na fila, -1 se a tabela ou a fila o
+// recusaram. Uma falha de escrita mais tarde acaba em REQ_TIMEOUT.
+int request_send_queued(RequestTable *t, TxQueue *q, TxLane lane, const char *uri, const char *body,
+                        uint16_t seq, uint32_t timeout_ms, RequestCallback cb, void *user);
+
+// Volta a esperar por um serial já enviado, sem enviar nada: a resposta a um
+// pedido repetido ainda pode chegar atrasada. Devolve 0, ou -1 se a tabela
+// estiver cheia ou o serial já estiver em voo (nesse caso o callback não é chamado).
+int request_table_watch(RequestTable *t, uint16_t seq, uint32_t timeout_ms, RequestCallback cb, void *user);
+// Completa só o pedido 'seq' com REQ_CANCELLED. Devolve 1 se ele estava em voo.
+int request_table_cancel(RequestTable *t, uint16_t seq);
+
+// Chamar no callback do decoder antes de tratar o pacote: se for uma resposta
+// (type 1) a um pedido em voo, entrega-a ao callback desse pedido e devolve 1
+// (o pacote deixou de ser nosso); senão devolve 0 e o pacote fica com quem chamou
+// (eventos e pedidos do módulo nunca completam um pedido).
+int request_table_complete(RequestTable *t, ParsedPacket *pkt);
+
+// Expira os pedidos fora de prazo (REQ_TIMEOUT)
+void request_table_poll(RequestTable *t);
+// Milissegundos até ao prazo mais próximo (REQUEST_NO_DEADLINE se não houver nada)
+uint32_t request_table_next_deadline(RequestTable *t);
+int request_table_pending(RequestTable *t);
+
+void request_future_init(RequestFuture *f);
+void request_future_cb(uint16_t serial, RequestStatus status, ParsedPacket *resp, void *user);
+
+#endif // REQUEST_TABLE_H
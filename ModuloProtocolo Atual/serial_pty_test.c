@@ -0,0 +1,403 @@
+#ifndef _WIN32 // Só POSIX: usa pseudo-terminais no lugar do módulo
+#define _XOPEN_SOURCE 600 // posix_openpt, grantpt, ptsname
+#define _DEFAULT_SOURCE   // usleep
+// --- TESTE PONTA A PONTA SOBRE UM PAR DE PSEUDO-TERMINAIS ---
+// O lado "mestre" do pty faz de módulo FacePass; o lado "escravo" é aberto com
+// serial_open como se fosse /dev/ttyUSB0. No Linux corre também uma carga de
+// PTY_LOAD_PORTS módulos em simultâneo sobre o serial_reactor.
+// Programa à parte (tem o seu main):
+//   gcc -O2 -std=c11 -I. serial_pty_test.c serial_transport_posix.c serial_reactor.c request_table.c
+//       tx_queue.c face_pass_api.c protocol_msg.c buffer_pool.c platform.c cJSON.c -lpthread -lm -o serial_pty_test
+// Sai com 0 se tudo passou.
+#include "serial_transport.h"
+#include "protocol_msg.h"
+#include "platform.h"
+#include "request_table.h"
+#include "serial_reactor.h"
+#include "face_pass_api.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PTY_TEST_FRAMES 40
+#define PTY_TEST_MAX_BODY (80 * 1024) // Como uma resposta de cadastro com o 'ft'
+#define PTY_LOAD_PORTS 8
+#define PTY_LOAD_WORKERS 3
+#define PTY_LOAD_FRAMES 300             // Por porta
+#define PTY_LOAD_MAX_BODY (16 * 1024)
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("  %-52s %s\n", what, ok ? "OK" : "[ERRO]");
+    if (!ok) failures++;
+}
+
+// Abre um pty; devolve o descritor do mestre e o nome do escravo em 'slave'
+static int pty_open(char *slave, size_t cap) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0) return -1;
+    if (grantpt(master) != 0 || unlockpt(master) != 0 || ptsname(master) == NULL) {
+        close(master);
+        return -1;
+    }
+    snprintf(slave, cap, "%s", ptsname(master));
+    return master;
+}
+
+// Pacote tal como o módulo o envia (type 1 = resposta, 2 = evento)
+static uint32_t module_frame(uint8_t *out, const char *uri, const char *body, uint32_t body_len,
+                             uint16_t serial, uint8_t type) {
+    ProtocolHeader h;
+    uint32_t uri_len = (uint32_t)strlen(uri) + 1;
+    memset(&h, 0, sizeof(h));
+    h.sync_flag = SYNC_FLAG_VALUE;
+    h.head_len = sizeof(ProtocolHeader);
+    h.uri_len = (uint8_t)uri_len;
+    h.msg_len = sizeof(ProtocolHeader) + uri_len + body_len;
+    h.serial = serial;
+    h.type = type;
+    h.head_crc16 = calc_crc16((const uint8_t*)&h + 12, 8);
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + sizeof(h), uri, uri_len);
+    memcpy(out + sizeof(h) + uri_len, body, body_len);
+    h.msg_crc32 = calc_crc32(out + 8, h.msg_len - 8);
+    memcpy(out, &h, sizeof(h));
+    return h.msg_len;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return 0;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int read_all(int fd, uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, data, len);
+        if (n <= 0) return 0;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static double cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// --- LADO DO HOST: FIFO + DECODER, COMO NO main.c ---
+
+typedef struct {
+    RequestTable *requests; // Se não for NULL, as respostas passam primeiro por aqui
+    int events;            // Pacotes type 2 (não contam como respostas)
+    int received;
+    int wrong;             // Serial, tipo ou corpo diferentes do enviado
+    uint32_t body_len[PTY_TEST_FRAMES];
+} PtyHost;
+
+static void pty_rx(const uint8_t *data, uint32_t length, void *user) {
+    rb_put((RingBuffer*)user, data, (int)length);
+}
+
+static void pty_on_packet(ParsedPacket *pkt, void *user) {
+    PtyHost *host = (PtyHost*)user;
+    if (host->requests != NULL && request_table_complete(host->requests, pkt)) return;
+    if (pkt->type == 2) {
+        host->events++;
+        protocol_packet_release(pkt);
+        return;
+    }
+    int i = host->received++;
+    int ok = i < PTY_TEST_FRAMES && pkt->serial == (uint16_t)(1000 + i) && pkt->type == 1 &&
+             pkt->body_len == host->body_len[i] && protocol_uri_contains(pkt, "/api/face/enroll");
+    for (uint32_t k = 0; ok && k < pkt->body_len; k++) ok = pkt->body[k] == (char)('A' + (k + i) % 26);
+    if (!ok) host->wrong++;
+    protocol_packet_release(pkt);
+}
+
+static void pty_pump(RingBuffer *rb, ProtocolDecoder *dec) {
+    RxSpan span;
+    if (rb_peek_span(rb, &span) == 0) return;
+    rb_consume(rb, (int)protocol_decoder_feed_span(dec, &span));
+}
+
+// --- REENVIO DE FEATURES PELA FILA DE ENVIO ---
+#define PTY_FEATURE_LEN 3000
+#define PTY_FEATURE_URI "/api/book/add/feature"
+
+static void pty_upload_done(int written, void *user) {
+    atomic_store((atomic_int*)user, written);
+}
+
+// FacePass_UploadFeature escreve o Base64 num buffer do pool que a fila só
+// devolve depois do envio: o módulo tem de receber a feature intacta e o pool
+// tem de ficar como estava
+static void pty_upload_feature_test(SerialHandle h, int master) {
+    static uint8_t feature[PTY_FEATURE_LEN];
+    static uint8_t got[PTY_FEATURE_LEN * 2];
+    static unsigned char decoded[PTY_FEATURE_LEN];
+    static TxQueue q;
+    atomic_int written = -2; // -2 = callback ainda não chamado
+    PoolStats before, after;
+    uint16_t seq = 500;
+
+    for (int i = 0; i < PTY_FEATURE_LEN; i++) feature[i] = (uint8_t)(i * 7 + 3);
+    pool_get_stats(&before);
+    if (!tx_queue_start(&q, h)) {
+        check(0, "tx_queue_start");
+        return;
+    }
+    int ok = FacePass_UploadFeature(&q, PTY_FEATURE_URI, 12, feature, PTY_FEATURE_LEN, &seq,
+                                    pty_upload_done, &written);
+    ProtocolHeader *gh = (ProtocolHeader*)got;
+    ok = ok && read_all(master, got, sizeof(ProtocolHeader)) && gh->msg_len <= sizeof(got) &&
+         read_all(master, got + sizeof(ProtocolHeader), gh->msg_len - sizeof(ProtocolHeader));
+    ParsedPacket pkt = protocol_parse_buffer(NULL, got, ok ? (int)gh->msg_len : 0);
+
+    int face_id = -1;
+    const char *ft = NULL;
+    size_t ft_len = 0, n = 0;
+    ok = ok && pkt.is_valid && pkt.serial == 500 && seq == 501 && protocol_uri_contains(&pkt, PTY_FEATURE_URI) &&
+         protocol_json_find_int(pkt.body, pkt.body_len, "face_id", &face_id) && face_id == 12 &&
+         protocol_json_find_string(pkt.body, pkt.body_len, "ft", &ft, &ft_len) &&
+         base64_decode_into(ft, ft_len, decoded, sizeof(decoded), &n) && n == PTY_FEATURE_LEN &&
+         memcmp(decoded, feature, PTY_FEATURE_LEN) == 0;
+    check(ok, "FacePass_UploadFeature chega ao modulo intacta");
+
+    uint32_t start = os_now_ms();
+    while (atomic_load(&written) == -2 && os_now_ms() - start < 2000) usleep(1000);
+    tx_queue_stop(&q);
+    pool_get_stats(&after);
+    check(atomic_load(&written) == (int)gh->msg_len, "callback do envio com o pacote inteiro");
+    check(after.in_use == before.in_use, "buffer do BODY devolvido ao pool");
+}
+
+static void pty_end_to_end_test(void) {
+    static uint8_t rb_memory[512 * 1024];
+    static uint8_t frame[PTY_TEST_MAX_BODY + 256];
+    static char body[PTY_TEST_MAX_BODY];
+    char slave[128];
+    RingBuffer rb;
+    ProtocolDecoder dec;
+    PtyHost host;
+
+    printf("\nSerial POSIX sobre um pty:\n");
+    int master = pty_open(slave, sizeof(slave));
+    check(master >= 0, "abrir o par de pseudo-terminais");
+    if (master < 0) return;
+
+    SerialHandle h = serial_open(slave, 115200);
+    check(h != NULL, "serial_open no lado escravo");
+    if (h == NULL) {
+        close(master);
+        return;
+    }
+    memset(&host, 0, sizeof(host));
+    rb_init(&rb, rb_memory, sizeof(rb_memory));
+    protocol_decoder_init(&dec, pty_on_packet, &host);
+    check(serial_start_rx_thread(h, pty_rx, &rb), "thread de leitura");
+
+    // 1. Host -> módulo: um comando chega inteiro e com os CRCs certos
+    uint8_t got[256];
+    int sent = protocol_send_msg(h, "/api/module/init", "{\"init\": 1}", 42);
+    ProtocolHeader *gh = (ProtocolHeader*)got;
+    int ok = sent > 0 && read_all(master, got, sizeof(ProtocolHeader)) && gh->msg_len <= sizeof(got) &&
+             read_all(master, got + sizeof(ProtocolHeader), gh->msg_len - sizeof(ProtocolHeader));
+    ParsedPacket cmd = protocol_parse_buffer(NULL, got, ok ? (int)gh->msg_len : 0);
+    check(ok && cmd.is_valid && cmd.serial == 42 && cmd.body_len == 11 && memcmp(cmd.body, "{\"init\": 1}", 11) == 0,
+          "protocol_send_msg chega ao modulo intacto");
+
+    // 2. Módulo -> host: respostas de 0 a 80 KB, escritas aos bocados de tamanho aleatório
+    uint32_t seed = 99;
+    for (int i = 0; i < PTY_TEST_FRAMES; i++) {
+        uint32_t len = (uint32_t)((uint64_t)PTY_TEST_MAX_BODY * i / (PTY_TEST_FRAMES - 1));
+        for (uint32_t k = 0; k < len; k++) body[k] = (char)('A' + (k + i) % 26);
+        host.body_len[i] = len;
+        uint32_t flen = module_frame(frame, "/api/face/enroll", body, len, (uint16_t)(1000 + i), 1);
+        for (uint32_t off = 0; off < flen;) {
+            seed = seed * 1103515245u + 12345u;
+            uint32_t piece = 1 + (seed >> 16) % 700;
+            if (piece > flen - off) piece = flen - off;
+            if (!write_all(master, frame + off, piece)) break;
+            off += piece;
+            pty_pump(&rb, &dec);
+        }
+    }
+    uint32_t start = os_now_ms();
+    while (host.received < PTY_TEST_FRAMES && os_now_ms() - start < 5000) {
+        serial_wait_rx(h, 100);
+        pty_pump(&rb, &dec);
+    }
+    check(host.received == PTY_TEST_FRAMES && host.wrong == 0, "40 respostas (0..80 KB) descodificadas por ordem");
+    check(dec.crc_errors == 0 && dec.header_errors == 0 && dec.head_crc16_mismatches == 0 &&
+          atomic_load(&rb.dropped) == 0,
+          "sem erros de CRC nem bytes perdidos");
+
+    // 3. Pedido em voo: um evento com o mesmo serial não o completa, a resposta sim
+    RequestTable table;
+    RequestFuture fut;
+    request_table_init(&table);
+    request_future_init(&fut);
+    host.requests = &table;
+    ok = request_send(&table, h, "/api/module/init", "{}", 77, 2000, request_future_cb, &fut) > 0 &&
+         read_all(master, got, sizeof(ProtocolHeader)) && gh->msg_len <= sizeof(got) &&
+         read_all(master, got + sizeof(ProtocolHeader), gh->msg_len - sizeof(ProtocolHeader));
+    uint32_t flen = module_frame(frame, "/api/face/recog", "{\"err_info\": 5}", 15, 77, 2);
+    flen += module_frame(frame + flen, "/api/module/init", "{\"err_info\": 0}", 15, 77, 1);
+    ok = ok && write_all(master, frame, flen);
+    start = os_now_ms();
+    while (ok && !fut.done && os_now_ms() - start < 2000) {
+        serial_wait_rx(h, 100);
+        pty_pump(&rb, &dec);
+    }
+    check(ok && host.events == 1 && fut.done && fut.status == REQ_OK && fut.err == 0,
+          "evento com o serial de um pedido nao o completa");
+    host.requests = NULL;
+    request_table_destroy(&table);
+
+    pty_upload_feature_test(h, master);
+
+    // 4. Hangup: o mestre fecha; a thread de leitura não pode ficar a rodar
+    close(master);
+    usleep(50000);
+    double cpu0 = cpu_seconds();
+    usleep(300000);
+    double cpu = cpu_seconds() - cpu0;
+    printf("  CPU em 300 ms depois do hangup: %.1f ms\n", cpu * 1000.0);
+    check(cpu < 0.05, "thread de leitura parada depois do hangup");
+
+    serial_close(h); // Tem de voltar: a thread acorda com o pedido de paragem
+    check(1, "serial_close depois do hangup");
+}
+
+// --- CARGA: N MÓDULOS EM SIMULTÂNEO NO REACTOR (Linux) ---
+#ifdef __linux__
+
+typedef struct {
+    int master;
+    int port_index;
+    OsThread writer;
+    atomic_int received;
+    atomic_int wrong;             // Fora de ordem ou corpo errado
+} PtyLoadPort;
+
+static uint32_t load_body_len(int port, int i) {
+    return (uint32_t)((i * 7919u + port * 131u) % PTY_LOAD_MAX_BODY);
+}
+
+static char load_byte(int port, int i, uint32_t k) {
+    return (char)('a' + (k + (uint32_t)i + (uint32_t)port) % 26);
+}
+
+// Um "módulo": manda as respostas em bocados de tamanho aleatório
+static void load_writer(void *arg) {
+    PtyLoadPort *lp = (PtyLoadPort*)arg;
+    static OS_THREAD_LOCAL uint8_t frame[PTY_LOAD_MAX_BODY + 256];
+    static OS_THREAD_LOCAL char body[PTY_LOAD_MAX_BODY];
+    uint32_t seed = 7u + (uint32_t)lp->port_index;
+
+    for (int i = 0; i < PTY_LOAD_FRAMES; i++) {
+        uint32_t len = load_body_len(lp->port_index, i);
+        for (uint32_t k = 0; k < len; k++) body[k] = load_byte(lp->port_index, i, k);
+        uint32_t flen = module_frame(frame, "/api/face/recog", body, len, (uint16_t)i, 2);
+        for (uint32_t off = 0; off < flen;) {
+            seed = seed * 1103515245u + 12345u;
+            uint32_t piece = 1 + (seed >> 16) % 3000;
+            if (piece > flen - off) piece = flen - off;
+            if (!write_all(lp->master, frame + off, piece)) return;
+            off += piece;
+        }
+    }
+}
+
+// Corre num worker; os pacotes de uma porta chegam sempre pela mesma ordem
+static void load_on_packet(ParsedPacket *pkt, void *user) {
+    PtyLoadPort *lp = (PtyLoadPort*)user;
+    int i = atomic_fetch_add(&lp->received, 1);
+    int ok = pkt->serial == (uint16_t)i && pkt->body_len == load_body_len(lp->port_index, i);
+    for (uint32_t k = 0; ok && k < pkt->body_len; k++) ok = pkt->body[k] == load_byte(lp->port_index, i, k);
+    if (!ok) atomic_fetch_add(&lp->wrong, 1);
+    protocol_packet_release(pkt);
+}
+
+static void pty_reactor_load_test(void) {
+    static PtyLoadPort ports[PTY_LOAD_PORTS];
+    char slave[128];
+
+    printf("\nReactor com %d pty em simultaneo (%d workers):\n", PTY_LOAD_PORTS, PTY_LOAD_WORKERS);
+    SerialReactor *r = reactor_create(PTY_LOAD_PORTS, PTY_LOAD_WORKERS);
+    check(r != NULL, "reactor_create");
+    if (r == NULL) return;
+
+    int opened = 0;
+    for (; opened < PTY_LOAD_PORTS; opened++) {
+        PtyLoadPort *lp = &ports[opened];
+        memset(lp, 0, sizeof(*lp));
+        lp->master = pty_open(slave, sizeof(slave));
+        if (lp->master < 0) break;
+        lp->port_index = reactor_add_port(r, slave, 115200, load_on_packet, lp);
+        if (lp->port_index != opened) {
+            close(lp->master);
+            break;
+        }
+    }
+    check(opened == PTY_LOAD_PORTS, "abrir e registar todas as portas");
+    check(reactor_start(r), "reactor_start");
+
+    uint64_t total = 0;
+    for (int p = 0; p < opened; p++)
+        for (int i = 0; i < PTY_LOAD_FRAMES; i++) total += load_body_len(p, i) + sizeof(ProtocolHeader) + 16;
+    uint32_t start = os_now_ms();
+    for (int p = 0; p < opened; p++) os_thread_start(&ports[p].writer, load_writer, &ports[p]);
+    for (int p = 0; p < opened; p++) os_thread_join(&ports[p].writer);
+
+    int all = 0;
+    while (os_now_ms() - start < 20000) {
+        all = 1;
+        for (int p = 0; p < opened; p++) all &= atomic_load(&ports[p].received) == PTY_LOAD_FRAMES;
+        if (all) break;
+        usleep(1000);
+    }
+    uint32_t elapsed = os_now_ms() - start;
+    printf("  %.1f MB em %u ms (%.1f MB/s)\n", (double)total / (1024.0 * 1024.0), elapsed,
+           (double)total / (1024.0 * 1024.0) / ((elapsed ? elapsed : 1) / 1000.0));
+
+    int wrong = 0, errors = 0;
+    for (int p = 0; p < opened; p++) {
+        ReactorPortStats st;
+        reactor_get_port_stats(r, p, &st);
+        wrong += atomic_load(&ports[p].wrong);
+        errors += (int)(st.header_errors + st.crc_errors + st.head_crc16_mismatches + st.rx_dropped + st.queue_dropped);
+        if (st.frames_ok != PTY_LOAD_FRAMES) errors++;
+    }
+    check(all && wrong == 0, "todos os pacotes por ordem em todas as portas");
+    check(errors == 0, "sem erros de CRC nem perdas (FIFO ou fila do worker)");
+
+    reactor_destroy(r); // Fecha os escravos antes dos mestres
+    for (int p = 0; p < opened; p++) close(ports[p].master);
+}
+
+#endif // __linux__
+
+int main(void) {
+    if (!pool_init()) return 1;
+    pty_end_to_end_test();
+#ifdef __linux__
+    pty_reactor_load_test();
+#endif
+    pool_destroy();
+    printf("\n%s\n", failures ? "FALHOU" : "TUDO OK");
+    return failures ? 1 : 0;
+}
+
+#endif // _WIN32
@@ -0,0 +1,312 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include "serial_reactor.h"
+#include "buffer_pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define REACTOR_RB_CAPACITY (512 * 1024) // Cada porta guarda um pacote inteiro em curso
+#define REACTOR_QUEUE_LEN   256          // Pacotes à espera por worker
+#define REACTOR_READ_CHUNK  4096
+
+typedef struct ReactorWorker ReactorWorker;
+
+// Estado de cada porta (substitui os globais de uma única porta)
+typedef struct {
+    SerialHandle serial;
+    int fd;
+    RingBuffer rx_fifo;
+    uint8_t *rb_memory;          // Só usado se o FIFO espelhado falhar
+    ProtocolDecoder decoder;
+    PacketCallback on_packet;
+    void *user;
+    ReactorWorker *worker;
+    uint64_t bytes_rx;
+    volatile uint32_t queue_dropped;
+    volatile bool closed;
+} ReactorPort;
+
+typedef struct {
+    ReactorPort *port;
+    ParsedPacket pkt;
+} ReactorJob;
+
+struct ReactorWorker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ReactorJob queue[REACTOR_QUEUE_LEN];
+    uint32_t head, tail;         // Contadores livres (índice = contador % REACTOR_QUEUE_LEN)
+    bool stopping;
+};
+
+struct SerialReactor {
+    int epfd;
+    int wake_fd;                 // eventfd: acorda o epoll_wait para parar
+    pthread_t loop_thread;
+    bool running;
+    int port_count, max_ports;
+    ReactorPort *ports;
+    int worker_count;
+    ReactorWorker workers[REACTOR_MAX_WORKERS];
+};
+
+// --- WORKERS (callbacks das aplicações) ---
+
+static void *worker_main(void *arg) {
+    ReactorWorker *w = (ReactorWorker*)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->head == w->tail && !w->stopping) pthread_cond_wait(&w->cond, &w->lock);
+        if (w->head == w->tail) break; // A parar e sem trabalho
+
+        ReactorJob job = w->queue[w->tail % REACTOR_QUEUE_LEN];
+        w->tail++;
+        if (w->stopping) {
+            // reactor_stop: não chama mais callbacks, só devolve os buffers
+            protocol_packet_release(&job.pkt);
+            continue;
+        }
+        pthread_mutex_unlock(&w->lock);
+        job.port->on_packet(&job.pkt, job.port->user);
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Chamado pelo decoder (thread do epoll) para cada pacote válido
+static void reactor_on_packet(ParsedPacket *pkt, void *user) {
+    ReactorPort *port = (ReactorPort*)user;
+    ReactorWorker *w = port->worker;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->head - w->tail == REACTOR_QUEUE_LEN) {
+        // Worker atrasado: não se bloqueia o epoll (pararia as outras portas)
+        pthread_mutex_unlock(&w->lock);
+        port->queue_dropped++;
+        protocol_packet_release(pkt);
+        return;
+    }
+    ReactorJob *job = &w->queue[w->head % REACTOR_QUEUE_LEN];
+    job->port = port;
+    job->pkt = *pkt; // O buffer do pool passa para o worker
+    w->head++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// --- CICLO DO EPOLL ---
+
+static void port_close_rx(SerialReactor *r, ReactorPort *port) {
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, port->fd, NULL);
+    port->closed = true;
+}
+
+static void port_on_readable(SerialReactor *r, ReactorPort *port) {
+    uint8_t buffer[REACTOR_READ_CHUNK];
+    ssize_t n = read(port->fd, buffer, sizeof(buffer));
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+        port_close_rx(r, port);
+        return;
+    }
+    port->bytes_rx += (uint64_t)n;
+
+    // A thread do epoll é produtora e consumidora do FIFO desta porta
+    rb_put(&port->rx_fifo, buffer, (int)n);
+    RxSpan span;
+    if (rb_peek_span(&port->rx_fifo, &span) == 0) return;
+    size_t used = protocol_decoder_feed_span(&port->decoder, &span);
+    rb_consume(&port->rx_fifo, (int)used);
+}
+
+static void *reactor_loop(void *arg) {
+    SerialReactor *r = (SerialReactor*)arg;
+    struct epoll_event events[64];
+
+    for (;;) {
+        int n = epoll_wait(r->epfd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) return NULL; // wake_fd: pedido de paragem
+
+            ReactorPort *port = (ReactorPort*)events[i].data.ptr;
+            if (events[i].events & EPOLLIN) port_on_readable(r, port);
+            else if (events[i].events & (EPOLLERR | EPOLLHUP)) port_close_rx(r, port);
+        }
+    }
+    return NULL;
+}
+
+// --- API ---
+
+SerialReactor *reactor_create(int max_ports, int workers) {
+    if (max_ports <= 0 || workers <= 0 || workers > REACTOR_MAX_WORKERS) return NULL;
+    if (!pool_init()) return NULL; // Antes das threads do reactor (ver serial_reactor.h)
+
+    SerialReactor *r = (SerialReactor*)calloc(1, sizeof(SerialReactor));
+    if (r == NULL) return NULL;
+    r->ports = (ReactorPort*)calloc((size_t)max_ports, sizeof(ReactorPort));
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (r->ports == NULL || r->epfd < 0 || r->wake_fd < 0) {
+        if (r->epfd >= 0) close(r->epfd);
+        if (r->wake_fd >= 0) close(r->wake_fd);
+        free(r->ports);
+        free(r);
+        return NULL;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wake_fd, &ev);
+
+    r->max_ports = max_ports;
+    r->worker_count = workers;
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&r->workers[i].lock, NULL);
+        pthread_cond_init(&r->workers[i].cond, NULL);
+    }
+    return r;
+}
+
+int reactor_add_port(SerialReactor *r, const char *portName, int baudRate,
+                     PacketCallback on_packet, void *user) {
+    if (r == NULL || r->running || r->port_count == r->max_ports || on_packet == NULL) return -1;
+
+    int index = r->port_count;
+    ReactorPort *port = &r->ports[index];
+    memset(port, 0, sizeof(*port));
+
+    port->serial = serial_open(portName, baudRate);
+    if (port->serial == NULL) return -1;
+    port->fd = serial_fd(port->serial);
+
+    if (!rb_init_mirrored(&port->rx_fifo, REACTOR_RB_CAPACITY)) {
+        port->rb_memory = (uint8_t*)malloc(REACTOR_RB_CAPACITY);
+        if (port->rb_memory == NULL) {
+            serial_close(port->serial);
+            return -1;
+        }
+        rb_init(&port->rx_fifo, port->rb_memory, REACTOR_RB_CAPACITY);
+    }
+
+    protocol_decoder_init(&port->decoder, reactor_on_packet, port);
+    port->on_packet = on_packet;
+    port->user = user;
+    port->worker = &r->workers[index % r->worker_count];
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = port };
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, port->fd, &ev) != 0) {
+        rb_destroy(&port->rx_fifo);
+        free(port->rb_memory);
+        serial_close(port->serial);
+        return -1;
+    }
+    r->port_count++;
+    return index;
+}
+
+bool reactor_start(SerialReactor *r) {
+    if (r == NULL || r->running) return false;
+
+    int started = 0;
+    for (; started < r->worker_count; started++) {
+        ReactorWorker *w = &r->workers[started];
+        w->stopping = false;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) break;
+    }
+    if (started == r->worker_count &&
+        pthread_create(&r->loop_thread, NULL, reactor_loop, r) == 0) {
+        r->running = true;
+        return true;
+    }
+
+    // Falhou a meio: desfaz as threads já criadas
+    for (int i = 0; i < started; i++) {
+        ReactorWorker *w = &r->workers[i];
+        pthread_mutex_lock(&w->lock);
+        w->stopping = true;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+    }
+    return false;
+}
+
+void reactor_stop(SerialReactor *r) {
+    if (r == NULL || !r->running) return;
+
+    uint64_t one = 1;
+    ssize_t wr = write(r->wake_fd, &one, sizeof(one));
+    (void)wr;
+    pthread_join(r->loop_thread, NULL);
+
+    for (int i = 0; i < r->worker_count; i++) {
+        ReactorWorker *w = &r->workers[i];
+        pthread_mutex_lock(&w->lock);
+        w->stopping = true;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+    }
+
+    // Reinicia o eventfd para um eventual novo reactor_start
+    uint64_t drain;
+    ssize_t rd = read(r->wake_fd, &drain, sizeof(drain));
+    (void)rd;
+    r->running = false;
+}
+
+void reactor_destroy(SerialReactor *r) {
+    if (r == NULL) return;
+    reactor_stop(r);
+
+    for (int i = 0; i < r->port_count; i++) {
+        ReactorPort *port = &r->ports[i];
+        protocol_decoder_reset(&port->decoder); // Devolve ao pool um pacote a meio
+        serial_close(port->serial);
+        rb_destroy(&port->rx_fifo);
+        free(port->rb_memory);
+    }
+    for (int i = 0; i < r->worker_count; i++) {
+        pthread_mutex_destroy(&r->workers[i].lock);
+        pthread_cond_destroy(&r->workers[i].cond);
+    }
+    close(r->wake_fd);
+    close(r->epfd);
+    free(r->ports);
+    free(r);
+}
+
+SerialHandle reactor_port_handle(SerialReactor *r, int port) {
+    if (r == NULL || port < 0 || port >= r->port_count) return NULL;
+    return r->ports[port].serial;
+}
+
+void reactor_get_port_stats(SerialReactor *r, int port, ReactorPortStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (r == NULL || port < 0 || port >= r->port_count) return;
+
+    // Leitura sem cadeado: contadores de diagnóstico, podem vir ligeiramente atrasados
+    ReactorPort *p = &r->ports[port];
+    out->bytes_rx = p->bytes_rx;
+    out->frames_ok = p->decoder.frames_ok;
+    out->header_errors = p->decoder.header_errors;
+    out->crc_errors = p->decoder.crc_errors;
+    out->head_crc16_mismatches = p->decoder.head_crc16_mismatches;
+    out->rx_dropped = atomic_load_explicit(&p->rx_fifo.dropped, memory_order_relaxed);
+    out->queue_dropped = p->queue_dropped;
+    out->closed = p->closed;
+}
+
+#endif // __linux__
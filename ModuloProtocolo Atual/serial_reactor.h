@@ -0,0 +1,56 @@
+#ifndef SERIAL_REACTOR_H
+#define SERIAL_REACTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "serial_transport.h"
+#include "protocol_msg.h"
+
+// --- REACTOR DE VÁRIAS PORTAS (Linux, epoll) ---
+// Um só processo serve N módulos FacePass: uma thread faz epoll sobre todas as
+// portas e descodifica os pacotes (cada porta tem o seu FIFO e o seu decoder);
+// um pequeno grupo de workers corre os callbacks (parse de JSON, ficheiros...).
+// Os pacotes de uma porta vão sempre para o mesmo worker, logo chegam por ordem.
+#ifdef __linux__
+
+#define REACTOR_MAX_WORKERS 16
+
+typedef struct SerialReactor SerialReactor;
+
+typedef struct {
+    uint64_t bytes_rx;          // Bytes lidos da porta
+    uint32_t frames_ok;         // Pacotes com CRC32 válido
+    uint32_t header_errors;     // Cabeçalhos rejeitados
+    uint32_t crc_errors;        // Pacotes com CRC32 errado
+    uint32_t head_crc16_mismatches; // Cabeçalhos com head_crc16 diferente (ver PROTOCOL_CHECK_HEAD_CRC16)
+    uint32_t rx_dropped;        // Bytes perdidos por FIFO cheio
+    uint32_t queue_dropped;     // Pacotes perdidos por fila do worker cheia
+    bool closed;                // A porta deu erro/HUP e saiu do epoll
+} ReactorPortStats;
+
+// 'max_ports' portas no máximo, 'workers' threads para os callbacks (1..16).
+// Os pacotes vêm do buffer_pool, que não pode ser inicializado com threads a
+// usá-lo: reactor_create chama pool_init (se ainda não foi chamado), por isso
+// tem de correr na thread principal antes de outras threads usarem o pool.
+// pool_destroy só depois de reactor_destroy.
+SerialReactor *reactor_create(int max_ports, int workers);
+
+// Abre a porta e regista-a (antes de reactor_start). 'on_packet' corre num
+// worker e é dono do pacote (tem de chamar protocol_packet_release).
+// Devolve o índice da porta, ou -1 em caso de erro.
+int reactor_add_port(SerialReactor *r, const char *portName, int baudRate,
+                     PacketCallback on_packet, void *user);
+
+bool reactor_start(SerialReactor *r);
+// Pára as threads; pacotes ainda na fila são devolvidos ao pool sem callback
+void reactor_stop(SerialReactor *r);
+// Fecha as portas e liberta tudo (chama reactor_stop se preciso)
+void reactor_destroy(SerialReactor *r);
+
+// Porta para enviar comandos (protocol_send_msg / FacePass_*)
+SerialHandle reactor_port_handle(SerialReactor *r, int port);
+void reactor_get_port_stats(SerialReactor *r, int port, ReactorPortStats *out);
+
+#endif // __linux__
+
+#endif // SERIAL_REACTOR_H
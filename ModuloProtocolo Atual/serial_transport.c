@@ -1,23 +1,34 @@
 #include "serial_transport.h"
+#ifdef _WIN32 // A versão POSIX está em serial_transport_posix.c
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-// Variáveis globais privadas desta camada para gerir a thread
-static HANDLE hThread = NULL;
-static bool is_running = false;
-static HANDLE hSerialGlobal = NULL;
-static SerialRxCallback rx_callback = NULL;
+// Estado de cada porta: várias portas podem estar abertas ao mesmo tempo
+struct SerialPort {
+    HANDLE h;
+    HANDLE hThread;
+    volatile bool is_running;
+    SerialRxCallback rx_callback;
+    void *rx_user;
+    HANDLE hRxEvent;   // Acorda o consumidor quando chegam bytes
+    CRITICAL_SECTION tx_lock; // Um envio de cada vez (os segmentos não se misturam)
+    volatile uint32_t tx_syscalls; // WriteFile feitos (métrica de envio)
+};
 
-// A Thread que corre em pano de fundo
+// A Thread que corre em pano de fundo (uma por porta)
 static DWORD WINAPI RxThreadFunc(LPVOID lpParam) {
+    SerialHandle port = (SerialHandle)lpParam;
     uint8_t buffer[1024];
     DWORD bytesRead;
 
-    while (is_running) {
-        // ReadFile tenta ler. Fica bloqueado no máximo 50ms (conforme configurado abaixo)
-        if (ReadFile(hSerialGlobal, buffer, sizeof(buffer), &bytesRead, NULL)) {
-            if (bytesRead > 0 && rx_callback != NULL) {
+    while (port->is_running) {
+        // ReadFile volta assim que houver bytes, ou ao fim de 50ms sem nenhum (ver timeouts abaixo)
+        if (ReadFile(port->h, buffer, sizeof(buffer), &bytesRead, NULL)) {
+            if (bytesRead > 0 && port->rx_callback != NULL) {
                 // Chegaram dados! Chama a função do main.c enviando os bytes
-                rx_callback(buffer, bytesRead);
+                port->rx_callback(buffer, bytesRead, port->rx_user);
+                SetEvent(port->hRxEvent); // Só depois de os bytes estarem no FIFO
             }
         } else {
             Sleep(5); // Pausa de segurança em caso de erro na porta
@@ -26,7 +37,7 @@ static DWORD WINAPI RxThreadFunc(LPVOID lpParam) {
     return 0;
 }
 
-HANDLE serial_open(const char *portName, int baudRate) {
+SerialHandle serial_open(const char *portName, int baudRate) {
     char path[20];
     sprintf(path, "\\\\.\\%s", portName);
     
@@ -44,48 +55,143 @@ HANDLE serial_open(const char *portName, int baudRate) {
 
     // CONFIGURAÇÃO DE TIMEOUTS (Muito importante para a thread não encravar para sempre)
     COMMTIMEOUTS timeouts = {0};
+    // MAXDWORD no intervalo E no multiplicador: o ReadFile devolve logo o que já
+    // chegou, e só espera (até 50ms) se ainda não houver nenhum byte. Com o
+    // multiplicador a 0, um pedido de 1024 bytes esperava os 50ms completos.
     timeouts.ReadIntervalTimeout = MAXDWORD; 
     timeouts.ReadTotalTimeoutConstant = 50; // A thread espera no máximo 50ms por bytes
-    timeouts.ReadTotalTimeoutMultiplier = 0;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
     SetCommTimeouts(hSerial, &timeouts);
 
-    return hSerial;
+    SerialHandle port = (SerialHandle)calloc(1, sizeof(struct SerialPort));
+    if (port == NULL) {
+        CloseHandle(hSerial);
+        return NULL;
+    }
+    port->h = hSerial;
+    InitializeCriticalSection(&port->tx_lock);
+    return port;
 }
 
-bool serial_start_rx_thread(HANDLE hSerial, SerialRxCallback callback) {
-    if (hThread != NULL || hSerial == NULL || callback == NULL) return false;
+bool serial_start_rx_thread(SerialHandle hSerial, SerialRxCallback callback, void *user) {
+    if (hSerial == NULL || hSerial->hThread != NULL || callback == NULL) return false;
+
+    hSerial->hRxEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (hSerial->hRxEvent == NULL) return false;
 
-    hSerialGlobal = hSerial;
-    rx_callback = callback;
-    is_running = true;
+    hSerial->rx_callback = callback;
+    hSerial->rx_user = user;
+    hSerial->is_running = true;
 
     // Cria e arranca a Thread do Windows
-    hThread = CreateThread(NULL, 0, RxThreadFunc, NULL, 0, NULL);
-    return (hThread != NULL);
+    hSerial->hThread = CreateThread(NULL, 0, RxThreadFunc, hSerial, 0, NULL);
+    if (hSerial->hThread == NULL) {
+        hSerial->is_running = false;
+        CloseHandle(hSerial->hRxEvent);
+        hSerial->hRxEvent = NULL;
+        return false;
+    }
+    return true;
 }
 
-void serial_stop_rx_thread() {
-    if (hThread != NULL) {
-        is_running = false; // Sinaliza o 'while' da thread para parar
-        WaitForSingleObject(hThread, 1000); // Aguarda até 1 segundo para ela fechar limpa
-        CloseHandle(hThread);
-        hThread = NULL;
+SerialEvent serial_rx_event(SerialHandle hSerial) {
+    return hSerial != NULL ? hSerial->hRxEvent : NULL;
+}
+
+int serial_wait_rx(SerialHandle hSerial, uint32_t timeout_ms) {
+    if (hSerial == NULL || hSerial->hRxEvent == NULL) return 0;
+    return WaitForSingleObject(hSerial->hRxEvent, timeout_ms) == WAIT_OBJECT_0;
+}
+
+void serial_stop_rx_thread(SerialHandle hSerial) {
+    if (hSerial != NULL && hSerial->hThread != NULL) {
+        hSerial->is_running = false; // Sinaliza o 'while' da thread para parar
+        // Aguarda até 1 segundo para ela fechar limpa (o ReadFile volta em 50ms)
+        if (WaitForSingleObject(hSerial->hThread, 1000) != WAIT_OBJECT_0) {
+            // A thread continua viva (callback encravado?) e ainda usa o hRxEvent
+            // e a própria porta: fechá-los agora seria usá-los depois de libertos.
+            // Fuga deliberada: ficam abertos, o hThread fica preenchido (uma nova
+            // chamada volta a esperar) e o serial_close não liberta a porta.
+            return;
+        }
+        CloseHandle(hSerial->hThread);
+        hSerial->hThread = NULL;
+        CloseHandle(hSerial->hRxEvent);
+        hSerial->hRxEvent = NULL;
     }
 }
 
-int serial_write(HANDLE hSerial, const uint8_t *data, uint32_t length) {
+int serial_write(SerialHandle hSerial, const uint8_t *data, uint32_t length) {
     if (hSerial == NULL || data == NULL || length == 0) return -1;
+    SerialSegment seg = { data, length };
+    return serial_writev(hSerial, &seg, 1);
+}
+
+#define SERIAL_GATHER_MAX 4096 // Pacotes até este tamanho saem num só WriteFile
+
+// Um WriteFile: 1 = tudo escrito, 0 = escrita curta (timeout), -1 = erro
+static int port_write(SerialHandle port, const uint8_t *data, DWORD len, int *total) {
     DWORD bytesWritten = 0;
-    if (WriteFile(hSerial, data, length, &bytesWritten, NULL)) return (int)bytesWritten;
-    return -1;
+    port->tx_syscalls++;
+    if (!WriteFile(port->h, data, len, &bytesWritten, NULL)) return -1;
+    *total += (int)bytesWritten;
+    return bytesWritten == len ? 1 : 0;
 }
 
-void serial_purge(HANDLE hSerial) {
-    if (hSerial != NULL) PurgeComm(hSerial, PURGE_RXCLEAR | PURGE_TXCLEAR);
+int serial_writev(SerialHandle hSerial, const SerialSegment *segs, int count) {
+    if (hSerial == NULL || segs == NULL || count <= 0) return -1;
+
+    // WriteFileGather só serve para ficheiros (páginas alinhadas, sem buffer):
+    // numa porta COM juntam-se os segmentos num buffer na pilha e sai um só
+    // WriteFile (cabeçalho + URI + corpo de um comando normal). Só um corpo
+    // maior que o buffer segue à parte, sem cópia.
+    uint8_t gather[SERIAL_GATHER_MAX];
+    DWORD used = 0;
+    int total = 0;
+    int rc = 1;
+    EnterCriticalSection(&hSerial->tx_lock);
+    for (int i = 0; i < count && rc == 1; i++) {
+        DWORD len = segs[i].len;
+        if (len == 0) continue;
+        if (used + len <= SERIAL_GATHER_MAX) {
+            memcpy(gather + used, segs[i].data, len);
+            used += len;
+            continue;
+        }
+        // Não cabe: despeja o que já está junto antes de seguir
+        if (used > 0) {
+            rc = port_write(hSerial, gather, used, &total);
+            used = 0;
+            if (rc != 1) break;
+        }
+        if (len <= SERIAL_GATHER_MAX) {
+            memcpy(gather, segs[i].data, len);
+            used = len;
+        } else {
+            rc = port_write(hSerial, segs[i].data, len, &total);
+        }
+    }
+    if (rc == 1 && used > 0) rc = port_write(hSerial, gather, used, &total);
+    LeaveCriticalSection(&hSerial->tx_lock);
+    return rc < 0 ? -1 : total; // Escrita curta (timeout): devolve o que saiu
 }
 
-void serial_close(HANDLE hSerial) {
-    serial_stop_rx_thread(); // Garante que a thread morre antes de fechar a porta
-    if (hSerial != NULL && hSerial != INVALID_HANDLE_VALUE) CloseHandle(hSerial);
+uint32_t serial_tx_syscalls(SerialHandle hSerial) {
+    return hSerial != NULL ? hSerial->tx_syscalls : 0;
 }
 
+void serial_purge(SerialHandle hSerial) {
+    if (hSerial != NULL) PurgeComm(hSerial->h, PURGE_RXCLEAR | PURGE_TXCLEAR);
+}
+
+void serial_close(SerialHandle hSerial) {
+    serial_stop_rx_thread(hSerial); // Garante que a thread morre antes de fechar a porta
+    if (hSerial == NULL) return;
+    if (hSerial->hThread != NULL) return; // Thread que não parou: a porta fica por libertar (ver acima)
+    if (hSerial->h != INVALID_HANDLE_VALUE) CloseHandle(hSerial->h);
+    DeleteCriticalSection(&hSerial->tx_lock);
+    free(hSerial);
+}
+
+#endif // _WIN32
+
@@ -1,21 +1,63 @@
 #ifndef SERIAL_TRANSPORT_H
 #define SERIAL_TRANSPORT_H
 
-#include <windows.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+// Duas implementações da mesma API: serial_transport.c (Win32) e
+// serial_transport_posix.c (termios + pthreads). Só uma é compilada.
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE SerialEvent;   // Evento auto-reset
+#else
+typedef int SerialEvent;      // Descritor que fica legível quando chegam bytes
+#endif
+
+// Porta aberta (opaca). NULL = porta inválida.
+typedef struct SerialPort *SerialHandle;
+
 // Tipo de função para o Callback. 
 // Será invocada automaticamente sempre que chegarem dados novos.
-typedef void (*SerialRxCallback)(const uint8_t *data, uint32_t length);
+// 'user' é o ponteiro passado a serial_start_rx_thread (ex.: o FIFO dessa porta).
+typedef void (*SerialRxCallback)(const uint8_t *data, uint32_t length, void *user);
+
+// portName: "COM14" no Windows, "/dev/ttyUSB0" (ou um pty) em POSIX
+SerialHandle serial_open(const char *portName, int baudRate);
+int serial_write(SerialHandle hSerial, const uint8_t *data, uint32_t length);
 
-HANDLE serial_open(const char *portName, int baudRate);
-int serial_write(HANDLE hSerial, const uint8_t *data, uint32_t length);
-void serial_purge(HANDLE hSerial);
-void serial_close(HANDLE hSerial);
+// Pedaço de um envio "scatter-gather": os bytes são lidos de onde estão, sem cópia
+typedef struct {
+    const void *data;
+    uint32_t len;
+} SerialSegment;
+
+// Envia os segmentos pela ordem, como uma só mensagem: nenhum outro envio para
+// a mesma porta se intromete no meio. Devolve o total escrito, ou -1.
+int serial_writev(SerialHandle hSerial, const SerialSegment *segs, int count);
+// Chamadas ao SO (WriteFile / writev) feitas até agora pelos envios desta porta
+uint32_t serial_tx_syscalls(SerialHandle hSerial);
+void serial_purge(SerialHandle hSerial);
+void serial_close(SerialHandle hSerial);
 
 // --- NOVAS FUNÇÕES DA THREAD ---
-bool serial_start_rx_thread(HANDLE hSerial, SerialRxCallback callback);
-void serial_stop_rx_thread();
+// Cada porta tem a sua própria thread de leitura, callback e evento
+bool serial_start_rx_thread(SerialHandle hSerial, SerialRxCallback callback, void *user);
+// No Windows espera 1s pela thread; se ela não parar, o evento e a porta ficam
+// de propósito por libertar (a thread ainda os usa)
+void serial_stop_rx_thread(SerialHandle hSerial);
+
+// Sinal dado pela thread depois de cada callback com dados. O consumidor espera
+// nele em vez de fazer polling; válido enquanto a thread corre.
+SerialEvent serial_rx_event(SerialHandle hSerial);
+
+// Bloqueia até ao próximo sinal de serial_rx_event() ou até 'timeout_ms'
+// (0xFFFFFFFF = sem prazo). Devolve 1 se chegaram bytes, 0 no timeout.
+int serial_wait_rx(SerialHandle hSerial, uint32_t timeout_ms);
+
+#ifndef _WIN32
+// Descritor da porta, para quem a quiser multiplexar sem a thread de leitura
+// (ex.: serial_reactor.c). Continua a pertencer ao SerialHandle.
+int serial_fd(SerialHandle hSerial);
+#endif
 
 #endif // SERIAL_TRANSPORT_H
\ No newline at end of file
@@ -0,0 +1,262 @@
+#ifndef _WIN32 // A versão Win32 está em serial_transport.c
+#define _DEFAULT_SOURCE // cfmakeraw, CRTSCTS
+#include "serial_transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Estado de cada porta: várias portas podem estar abertas ao mesmo tempo
+struct SerialPort {
+    int fd;
+    pthread_t rx_thread;
+    bool thread_started;
+    SerialRxCallback rx_callback;
+    void *rx_user;
+    int stop_pipe[2];    // Escrever em [1] acorda e termina a thread
+    int event_pipe[2];   // [0] fica legível quando chegam bytes
+    pthread_mutex_t tx_lock; // Um envio de cada vez (os segmentos não se misturam)
+    volatile uint32_t tx_syscalls; // writev feitos (métrica de envio)
+};
+
+static void close_pipe(int p[2]) {
+    if (p[0] >= 0) close(p[0]);
+    if (p[1] >= 0) close(p[1]);
+    p[0] = p[1] = -1;
+}
+
+static int open_pipe(int p[2]) {
+    if (pipe(p) != 0) return 0;
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    fcntl(p[1], F_SETFL, O_NONBLOCK);
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    return 1;
+}
+
+static speed_t baud_to_speed(int baudRate) {
+    switch (baudRate) {
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif
+#ifdef B921600
+    case 921600: return B921600;
+#endif
+    default:     return 0;
+    }
+}
+
+// Pausa quando a porta não tem ninguém do outro lado (hangup): o poll()
+// continuaria a acordar logo e a thread rodaria em seco
+#define RX_HANGUP_BACKOFF_US 5000
+
+// A thread que corre em pano de fundo (uma por porta). Não há timeout: fica
+// parada no poll() até chegarem bytes ou até serial_stop_rx_thread a acordar.
+static void *RxThreadFunc(void *arg) {
+    SerialHandle port = (SerialHandle)arg;
+    uint8_t buffer[1024];
+    struct pollfd fds[2] = {
+        { .fd = port->fd,           .events = POLLIN },
+        { .fd = port->stop_pipe[0], .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break; // Pedido de paragem
+        if (fds[0].revents & (POLLERR | POLLNVAL)) break;
+        if ((fds[0].revents & POLLHUP) && !(fds[0].revents & POLLIN)) {
+            // Do outro lado ninguém tem o dispositivo aberto (ex.: pty ainda sem
+            // mestre a escrever): evita rodar em seco
+            usleep(RX_HANGUP_BACKOFF_US);
+            continue;
+        }
+
+        ssize_t n = read(port->fd, buffer, sizeof(buffer));
+        if (n > 0 && port->rx_callback != NULL) {
+            // Chegaram dados! Chama a função do main.c enviando os bytes
+            port->rx_callback(buffer, (uint32_t)n, port->rx_user);
+            uint8_t one = 1;
+            ssize_t w = write(port->event_pipe[1], &one, 1); // Cheio = já há sinal pendente
+            (void)w;
+        } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            // Fim de ficheiro ou EIO depois de um hangup (o poll diz POLLIN|POLLHUP
+            // mas não há nada para ler): mesma pausa que no POLLHUP sozinho
+            usleep(RX_HANGUP_BACKOFF_US);
+        }
+    }
+    return NULL;
+}
+
+SerialHandle serial_open(const char *portName, int baudRate) {
+    speed_t speed = baud_to_speed(baudRate);
+    if (speed == 0) return NULL;
+
+    int fd = open(portName, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        return NULL;
+    }
+    cfmakeraw(&tio);                   // 8 bits, sem paridade, sem eco nem tradução de bytes
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS); // Um stop bit, sem controlo de fluxo
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    // VMIN=1/VTIME=0: read() devolve logo o que houver (a espera é feita no poll)
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    SerialHandle port = (SerialHandle)calloc(1, sizeof(struct SerialPort));
+    if (port == NULL) {
+        close(fd);
+        return NULL;
+    }
+    port->fd = fd;
+    port->stop_pipe[0] = port->stop_pipe[1] = -1;
+    port->event_pipe[0] = port->event_pipe[1] = -1;
+    pthread_mutex_init(&port->tx_lock, NULL);
+    return port;
+}
+
+bool serial_start_rx_thread(SerialHandle hSerial, SerialRxCallback callback, void *user) {
+    if (hSerial == NULL || hSerial->thread_started || callback == NULL) return false;
+
+    if (!open_pipe(hSerial->stop_pipe)) return false;
+    if (!open_pipe(hSerial->event_pipe)) {
+        close_pipe(hSerial->stop_pipe);
+        return false;
+    }
+
+    hSerial->rx_callback = callback;
+    hSerial->rx_user = user;
+
+    if (pthread_create(&hSerial->rx_thread, NULL, RxThreadFunc, hSerial) != 0) {
+        close_pipe(hSerial->stop_pipe);
+        close_pipe(hSerial->event_pipe);
+        return false;
+    }
+    hSerial->thread_started = true;
+    return true;
+}
+
+void serial_stop_rx_thread(SerialHandle hSerial) {
+    if (hSerial == NULL || !hSerial->thread_started) return;
+    uint8_t one = 1;
+    ssize_t w = write(hSerial->stop_pipe[1], &one, 1); // Acorda o poll() da thread
+    (void)w;
+    pthread_join(hSerial->rx_thread, NULL);
+    hSerial->thread_started = false;
+    close_pipe(hSerial->stop_pipe);
+    close_pipe(hSerial->event_pipe);
+}
+
+SerialEvent serial_rx_event(SerialHandle hSerial) {
+    return hSerial != NULL ? hSerial->event_pipe[0] : -1;
+}
+
+int serial_wait_rx(SerialHandle hSerial, uint32_t timeout_ms) {
+    if (hSerial == NULL || hSerial->event_pipe[0] < 0) return 0;
+    struct pollfd pfd = { .fd = hSerial->event_pipe[0], .events = POLLIN };
+    int timeout = timeout_ms == 0xFFFFFFFF ? -1 : (int)timeout_ms;
+    int r;
+    do {
+        r = poll(&pfd, 1, timeout);
+    } while (r < 0 && errno == EINTR);
+    if (r <= 0) return 0;
+
+    // Consome os sinais acumulados (tal como um evento auto-reset)
+    uint8_t drain[64];
+    while (read(hSerial->event_pipe[0], drain, sizeof(drain)) > 0) {}
+    return 1;
+}
+
+int serial_fd(SerialHandle hSerial) {
+    return hSerial != NULL ? hSerial->fd : -1;
+}
+
+int serial_write(SerialHandle hSerial, const uint8_t *data, uint32_t length) {
+    if (hSerial == NULL || data == NULL || length == 0) return -1;
+    SerialSegment seg = { data, length };
+    return serial_writev(hSerial, &seg, 1);
+}
+
+#define SERIAL_MAX_SEGMENTS 8
+
+int serial_writev(SerialHandle hSerial, const SerialSegment *segs, int count) {
+    if (hSerial == NULL || segs == NULL || count <= 0 || count > SERIAL_MAX_SEGMENTS) return -1;
+
+    struct iovec iov[SERIAL_MAX_SEGMENTS];
+    size_t remaining = 0;
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = (void*)segs[i].data;
+        iov[i].iov_len = segs[i].len;
+        remaining += segs[i].len;
+    }
+
+    // Um só writev na maioria dos casos; se a escrita for parcial, avança os
+    // segmentos já enviados e continua de onde ficou
+    struct iovec *cur = iov;
+    int left = count;
+    size_t sent = 0;
+    pthread_mutex_lock(&hSerial->tx_lock);
+    while (remaining > 0) {
+        hSerial->tx_syscalls++;
+        ssize_t n = writev(hSerial->fd, cur, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        sent += (size_t)n;
+        remaining -= (size_t)n;
+        while (left > 0 && (size_t)n >= cur->iov_len) {
+            n -= (ssize_t)cur->iov_len;
+            cur++;
+            left--;
+        }
+        if (left > 0) {
+            cur->iov_base = (uint8_t*)cur->iov_base + n;
+            cur->iov_len -= (size_t)n;
+        }
+    }
+    pthread_mutex_unlock(&hSerial->tx_lock);
+    if (remaining > 0 && sent == 0) return -1;
+    return (int)sent;
+}
+
+uint32_t serial_tx_syscalls(SerialHandle hSerial) {
+    return hSerial != NULL ? hSerial->tx_syscalls : 0;
+}
+
+void serial_purge(SerialHandle hSerial) {
+    if (hSerial != NULL) tcflush(hSerial->fd, TCIOFLUSH);
+}
+
+void serial_close(SerialHandle hSerial) {
+    serial_stop_rx_thread(hSerial); // Garante que a thread morre antes de fechar a porta
+    if (hSerial == NULL) return;
+    close(hSerial->fd);
+    pthread_mutex_destroy(&hSerial->tx_lock);
+    free(hSerial);
+}
+
+#endif // _WIN32
@@ -0,0 +1,309 @@
+#include "tx_queue.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- FILA MPSC POR FAIXA ---
+
+static void lane_init(TxLaneQueue *l) {
+    atomic_init(&l->stub.next, NULL);
+    atomic_init(&l->head, &l->stub);
+    l->tail = &l->stub;
+}
+
+// Qualquer thread. Entre a troca e o store do 'next' a fila fica "partida" por
+// instantes: lane_pop vê isso e devolve NULL; o produtor acorda a escritora a seguir.
+static void lane_push(TxLaneQueue *l, TxFrame *f) {
+    atomic_store_explicit(&f->next, NULL, memory_order_relaxed);
+    TxFrame *prev = atomic_exchange_explicit(&l->head, f, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, f, memory_order_release);
+}
+
+// Só a thread escritora
+static TxFrame *lane_pop(TxLaneQueue *l) {
+    TxFrame *tail = l->tail;
+    TxFrame *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &l->stub) {
+        if (next == NULL) return NULL;
+        l->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        l->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&l->head, memory_order_acquire)) return NULL; // Push a meio
+
+    // 'tail' é o último: volta a pôr o stub atrás dele para o poder tirar
+    lane_push(l, &l->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        l->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+// --- RESERVA DE DESCRITORES ---
+// Um push não custa um malloc: os TxFrame vêm de uma reserva fixa dentro da
+// TxQueue. Só com mais de TX_QUEUE_FRAMES pacotes na fila se recorre ao malloc.
+
+static TxFrame *frame_alloc(TxQueue *q) {
+    os_lock(&q->free_lock);
+    TxFrame *f = q->free_frames;
+    if (f != NULL) q->free_frames = atomic_load_explicit(&f->next, memory_order_relaxed);
+    os_unlock(&q->free_lock);
+    if (f != NULL) {
+        f->heap = 0;
+        return f;
+    }
+    f = (TxFrame*)malloc(sizeof(TxFrame));
+    if (f != NULL) f->heap = 1;
+    return f;
+}
+
+static void frame_free(TxQueue *q, TxFrame *f) {
+    if (f->heap) {
+        free(f);
+        return;
+    }
+    os_lock(&q->free_lock);
+    atomic_store_explicit(&f->next, q->free_frames, memory_order_relaxed);
+    q->free_frames = f;
+    os_unlock(&q->free_lock);
+}
+
+// --- THREAD ESCRITORA ---
+
+static void frame_finish(TxQueue *q, TxFrame *f, int written) {
+    if (written < 0) atomic_fetch_add(&q->failed[f->lane], 1);
+    else atomic_fetch_add(&q->sent[f->lane], 1);
+    if (f->done) f->done(written, f->user);
+    pool_release(f->body_copy);
+    frame_free(q, f);
+}
+
+static void frame_record_wait(TxQueue *q, TxFrame *f, uint64_t now_us) {
+    uint64_t wait = now_us - f->enqueued_us;
+    q->wait_us_total[f->lane] += wait;
+    if (wait > q->wait_us_max[f->lane]) q->wait_us_max[f->lane] = (uint32_t)(wait > 0xFFFFFFFFu ? 0xFFFFFFFFu : wait);
+}
+
+// Pacote grande: sai sozinho, do sítio onde está
+static void frame_write(TxQueue *q, TxFrame *f) {
+    frame_record_wait(q, f, os_now_us());
+
+    uint32_t body_len = f->frame_len - sizeof(ProtocolHeader) - f->header.uri_len;
+    SerialSegment segs[3] = {
+        { &f->header, sizeof(ProtocolHeader) },
+        { f->uri, f->header.uri_len },
+        { f->body, body_len },
+    };
+    int written = serial_writev(q->hSerial, segs, body_len > 0 ? 3 : 2);
+    // Escrita curta (timeout da porta): o módulo recebeu um pacote cortado
+    if (written >= 0 && (uint32_t)written != f->frame_len) written = -1;
+    frame_finish(q, f, written);
+}
+
+static int batch_fits(TxQueue *q, TxFrame *f) {
+    return q->batch_count < TX_COALESCE_MAX_FRAMES && q->batch_len + f->frame_len <= TX_COALESCE_BUF;
+}
+
+static void batch_add(TxQueue *q, TxFrame *f) {
+    uint8_t *dst = q->batch + q->batch_len;
+    uint32_t body_len = f->frame_len - sizeof(ProtocolHeader) - f->header.uri_len;
+    memcpy(dst, &f->header, sizeof(ProtocolHeader));
+    memcpy(dst + sizeof(ProtocolHeader), f->uri, f->header.uri_len);
+    if (body_len > 0) memcpy(dst + sizeof(ProtocolHeader) + f->header.uri_len, f->body, body_len);
+    q->batch_len += f->frame_len;
+    q->batch_frames[q->batch_count++] = f;
+}
+
+// Uma só escrita para o grupo inteiro; cada pacote só conta como enviado se
+// os seus bytes couberam no que a porta aceitou
+static void batch_flush(TxQueue *q) {
+    if (q->batch_count == 0) return;
+
+    uint64_t now = os_now_us();
+    for (int i = 0; i < q->batch_count; i++) frame_record_wait(q, q->batch_frames[i], now);
+
+    SerialSegment seg = { q->batch, q->batch_len };
+    int written = serial_writev(q->hSerial, &seg, 1);
+
+    uint32_t end = 0;
+    for (int i = 0; i < q->batch_count; i++) {
+        TxFrame *f = q->batch_frames[i];
+        end += f->frame_len;
+        int ok = written >= 0 && (uint32_t)written >= end;
+        if (ok && q->batch_count > 1) q->coalesced[f->lane]++;
+        frame_finish(q, f, ok ? (int)f->frame_len : -1);
+    }
+    q->batch_len = 0;
+    q->batch_count = 0;
+}
+
+// CONTROL primeiro, sempre
+static TxFrame *pop_next(TxQueue *q) {
+    TxFrame *f = lane_pop(&q->lanes[TX_LANE_CONTROL]);
+    if (f == NULL) f = lane_pop(&q->lanes[TX_LANE_BULK]);
+    return f;
+}
+
+static void tx_writer_main(void *arg) {
+    TxQueue *q = (TxQueue*)arg;
+    TxFrame *f = NULL; // Tirado da fila mas ainda não enviado
+
+    while (atomic_load(&q->running)) {
+        if (f == NULL) f = pop_next(q);
+        if (f == NULL) {
+            os_event_wait(&q->wake, OS_WAIT_FOREVER);
+            continue;
+        }
+
+        uint32_t max_frame = atomic_load(&q->coalesce_max);
+        if (f->frame_len > max_frame) {
+            frame_write(q, f);
+            f = NULL;
+            continue;
+        }
+
+        // Abre um grupo e junta-lhe o que já está na fila, e (só com BULK) o que
+        // chegar até ao fim da janela; um pacote que não caiba (ou seja grande)
+        // fecha o grupo e fica para a volta seguinte
+        uint64_t deadline = os_now_us() + (uint64_t)atomic_load(&q->coalesce_ms) * 1000u;
+        for (;;) {
+            if (f->lane == TX_LANE_CONTROL) deadline = 0; // Comando: sai sem esperar
+            batch_add(q, f);
+            f = pop_next(q);
+            while (f == NULL) {
+                uint64_t now = os_now_us();
+                if (now >= deadline || !atomic_load(&q->running)) break;
+                os_event_wait(&q->wake, (uint32_t)((deadline - now + 999u) / 1000u));
+                f = pop_next(q);
+            }
+            if (f == NULL || f->frame_len > max_frame || !batch_fits(q, f)) break;
+        }
+        batch_flush(q);
+    }
+    if (f != NULL) frame_finish(q, f, -1);
+}
+
+// --- API ---
+
+int tx_queue_start(TxQueue *q, SerialHandle hSerial) {
+    memset(q, 0, sizeof(*q));
+    if (hSerial == NULL || !os_event_init(&q->wake)) return 0;
+    q->hSerial = hSerial;
+    for (int lane = 0; lane < TX_LANE_COUNT; lane++) lane_init(&q->lanes[lane]);
+    os_lock_init(&q->free_lock);
+    for (int i = TX_QUEUE_FRAMES - 1; i >= 0; i--) frame_free(q, &q->frame_store[i]);
+
+    atomic_store(&q->coalesce_ms, TX_COALESCE_DEFAULT_MS);
+    atomic_store(&q->coalesce_max, TX_COALESCE_DEFAULT_MAX);
+
+    atomic_store(&q->running, 1);
+    if (!os_thread_start(&q->writer, tx_writer_main, q)) {
+        atomic_store(&q->running, 0);
+        os_event_destroy(&q->wake);
+        os_lock_destroy(&q->free_lock);
+        return 0;
+    }
+    return 1;
+}
+
+void tx_queue_stop(TxQueue *q) {
+    if (!atomic_exchange(&q->running, 0)) return;
+    os_event_set(&q->wake);
+    os_thread_join(&q->writer);
+
+    // Sem escritora, quem pára passa a ser o único consumidor: o que ficou não é enviado
+    for (int lane = 0; lane < TX_LANE_COUNT; lane++) {
+        TxFrame *f;
+        while ((f = lane_pop(&q->lanes[lane])) != NULL) frame_finish(q, f, -1);
+    }
+    os_event_destroy(&q->wake);
+    os_lock_destroy(&q->free_lock);
+}
+
+// 'owned' (se não for NULL) é o buffer onde está o BODY e passa a ser da fila
+static int tx_queue_push(TxQueue *q, TxLane lane, const char *uri, const uint8_t *body, uint32_t body_len,
+                         PoolBuffer *owned, uint16_t seq, TxDoneCallback done, void *user) {
+    TxFrame *f = NULL;
+    if (atomic_load(&q->running) && uri != NULL && lane < TX_LANE_COUNT) f = frame_alloc(q);
+    if (f == NULL) {
+        pool_release(owned);
+        return 0;
+    }
+    uint8_t heap = f->heap;
+    memset(f, 0, offsetof(TxFrame, uri));
+    f->heap = heap;
+    if (!protocol_build_header(&f->header, uri, body, body_len, seq)) {
+        pool_release(owned);
+        frame_free(q, f);
+        return 0;
+    }
+    memcpy(f->uri, uri, f->header.uri_len);
+    f->frame_len = f->header.msg_len;
+    f->lane = (uint8_t)lane;
+
+    f->body = body;
+    f->body_copy = owned;
+    if (owned == NULL && done == NULL && body_len > 0) {
+        // Sem callback o chamador pode libertar o BODY logo: fica uma cópia
+        f->body_copy = pool_acquire(body_len);
+        if (f->body_copy == NULL) {
+            frame_free(q, f);
+            return 0;
+        }
+        memcpy(f->body_copy->data, body, body_len);
+        f->body = f->body_copy->data;
+    }
+    f->done = done;
+    f->user = user;
+    f->enqueued_us = os_now_us();
+
+    unsigned depth = atomic_fetch_add(&q->enqueued[lane], 1) + 1
+                   - atomic_load(&q->sent[lane]) - atomic_load(&q->failed[lane]);
+    unsigned peak = atomic_load(&q->depth_peak[lane]);
+    while (depth > peak && !atomic_compare_exchange_weak(&q->depth_peak[lane], &peak, depth)) {}
+
+    lane_push(&q->lanes[lane], f);
+    os_event_set(&q->wake);
+    return 1;
+}
+
+int tx_queue_send(TxQueue *q, TxLane lane, const char *uri, const uint8_t *body, uint32_t body_len,
+                  uint16_t seq, TxDoneCallback done, void *user) {
+    return tx_queue_push(q, lane, uri, body, body_len, NULL, seq, done, user);
+}
+
+int tx_queue_send_pooled(TxQueue *q, TxLane lane, const char *uri, PoolBuffer *body, uint32_t body_len,
+                         uint16_t seq, TxDoneCallback done, void *user) {
+    if (body == NULL || body_len > body->capacity) {
+        pool_release(body);
+        return 0;
+    }
+    return tx_queue_push(q, lane, uri, body->data, body_len, body, seq, done, user);
+}
+
+void tx_queue_set_coalescing(TxQueue *q, uint32_t max_delay_ms, uint32_t max_frame) {
+    if (max_frame > TX_COALESCE_BUF) max_frame = TX_COALESCE_BUF;
+    atomic_store(&q->coalesce_ms, max_delay_ms);
+    atomic_store(&q->coalesce_max, max_frame);
+}
+
+void tx_queue_get_stats(TxQueue *q, TxLane lane, TxLaneStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (lane >= TX_LANE_COUNT) return;
+    out->enqueued = atomic_load(&q->enqueued[lane]);
+    out->sent = atomic_load(&q->sent[lane]);
+    out->failed = atomic_load(&q->failed[lane]);
+    out->depth = out->enqueued - out->sent - out->failed;
+    out->depth_peak = atomic_load(&q->depth_peak[lane]);
+    // Tempos de espera: escritos só pela escritora, lidos aqui sem cadeado
+    out->wait_us_total = q->wait_us_total[lane];
+    out->wait_us_max = q->wait_us_max[lane];
+    out->coalesced = q->coalesced[lane];
+}
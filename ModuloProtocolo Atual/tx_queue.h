@@ -0,0 +1,120 @@
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "platform.h"
+#include "protocol_msg.h"
+
+// --- FILA DE ENVIO (vários produtores, uma thread escritora por porta) ---
+// Qualquer thread pode pôr pacotes na fila sem bloquear (MPSC sem cadeados);
+// só a thread escritora toca na porta, logo os pacotes nunca se misturam.
+// Duas faixas: CONTROL passa sempre à frente de BULK. Um pacote já a meio do
+// envio não é interrompido, por isso um comando urgente espera no máximo o
+// pacote BULK que estiver a sair nesse momento.
+//
+// Agrupamento: pacotes pequenos que já estejam na fila são copiados para um só
+// buffer e saem numa única escrita, em vez de uma chamada ao SO por comando.
+// A janela (esperar mais uns ms por pacotes que ainda vão chegar) vem desligada:
+// atrasaria cada comando isolado, e no Windows uma espera curta dura ~15.6 ms.
+// Liga-se com tx_queue_set_coalescing para rajadas BULK, e mesmo assim um
+// pacote CONTROL no grupo fá-lo sair logo (uma pausa nunca espera pela janela).
+#define TX_COALESCE_BUF          4096  // Bytes máximos de uma escrita agrupada
+#define TX_COALESCE_MAX_FRAMES   64
+#define TX_COALESCE_DEFAULT_MS   0     // Só junta o que já está na fila
+#define TX_COALESCE_BULK_MS      2     // Janela sugerida para rajadas BULK (~ um comando curto a 115200 baud)
+#define TX_COALESCE_DEFAULT_MAX  512   // Pacotes maiores saem sozinhos, sem cópia
+#define TX_QUEUE_FRAMES          64    // Descritores pré-alocados (a mais: malloc de recurso)
+
+typedef enum {
+    TX_LANE_CONTROL = 0,   // Comandos curtos e urgentes (pausa, init, ...)
+    TX_LANE_BULK,          // Transferências grandes (features, imagens)
+    TX_LANE_COUNT
+} TxLane;
+
+// Chamado pela thread escritora depois do envio (written = bytes, ou -1).
+// Com callback, o BODY é emprestado: tem de continuar válido até esta chamada.
+typedef void (*TxDoneCallback)(int written, void *user);
+
+typedef struct TxFrame {
+    _Atomic(struct TxFrame *) next;
+    ProtocolHeader header;       // Já com os CRCs
+    char uri[256];
+    const uint8_t *body;
+    PoolBuffer *body_copy;       // Cópia do BODY quando não é emprestado
+    uint64_t enqueued_us;
+    uint32_t frame_len;          // Cabeçalho + URI + BODY
+    uint8_t lane;
+    uint8_t heap;                // 1 = malloc de recurso (reserva da fila esgotada)
+    TxDoneCallback done;
+    void *user;
+} TxFrame;
+
+// Fila intrusiva MPSC (Vyukov): push = uma troca atómica, pop só pela escritora
+typedef struct {
+    _Atomic(TxFrame *) head;     // Último inserido (produtores)
+    TxFrame *tail;               // Próximo a sair (só a escritora)
+    TxFrame stub;
+} TxLaneQueue;
+
+typedef struct {
+    uint32_t enqueued;
+    uint32_t sent;
+    uint32_t failed;             // Erro de escrita ou fila parada
+    uint32_t depth;              // Pacotes à espera neste momento
+    uint32_t depth_peak;
+    uint64_t wait_us_total;      // Soma dos tempos entre a entrada na fila e o início do envio
+    uint32_t wait_us_max;
+    uint32_t coalesced;          // Enviados dentro de uma escrita agrupada
+} TxLaneStats;
+
+typedef struct {
+    SerialHandle hSerial;
+    TxLaneQueue lanes[TX_LANE_COUNT];
+    OsEvent wake;
+    OsThread writer;
+    atomic_int running;
+    // Métricas: depth/enqueued mexidos pelos produtores, o resto só pela escritora
+    atomic_uint enqueued[TX_LANE_COUNT];
+    atomic_uint depth_peak[TX_LANE_COUNT];
+    atomic_uint sent[TX_LANE_COUNT];
+    atomic_uint failed[TX_LANE_COUNT];
+    uint64_t wait_us_total[TX_LANE_COUNT];
+    uint32_t wait_us_max[TX_LANE_COUNT];
+    uint32_t coalesced[TX_LANE_COUNT];
+    // Agrupamento (só a escritora mexe no buffer e na lista)
+    atomic_uint coalesce_ms;
+    atomic_uint coalesce_max;
+    uint8_t batch[TX_COALESCE_BUF];
+    uint32_t batch_len;
+    TxFrame *batch_frames[TX_COALESCE_MAX_FRAMES];
+    int batch_count;
+    // Reserva de descritores: os produtores tiram, a escritora devolve
+    OsLock free_lock;
+    TxFrame *free_frames;
+    TxFrame frame_store[TX_QUEUE_FRAMES];
+} TxQueue;
+
+// Arranca a thread escritora da porta (agrupamento com os valores por omissão)
+int tx_queue_start(TxQueue *q, SerialHandle hSerial);
+// Muda o agrupamento a qualquer momento: 'max_delay_ms' de espera por mais
+// pacotes enquanto o grupo só tiver BULK (0 = sem janela), só para pacotes até
+// 'max_frame' bytes (0 = desligado)
+void tx_queue_set_coalescing(TxQueue *q, uint32_t max_delay_ms, uint32_t max_frame);
+// Pára a escritora; o que ainda estiver na fila termina com written = -1.
+// Não chamar em paralelo com tx_queue_send.
+void tx_queue_stop(TxQueue *q);
+
+// Monta o cabeçalho (CRCs incluídos) e põe o pacote na faixa 'lane'.
+// Sem 'done', o BODY é copiado para um buffer do pool e pode ser libertado logo;
+// com 'done', é enviado do sítio onde está (sem cópia). Devolve 0 se recusado.
+int tx_queue_send(TxQueue *q, TxLane lane, const char *uri, const uint8_t *body, uint32_t body_len,
+                  uint16_t seq, TxDoneCallback done, void *user);
+// Igual, mas o BODY já foi escrito pelo chamador num buffer do pool (ex.: com
+// base64_encode_into): a fila fica com o buffer, mesmo se recusar, e não copia nada
+int tx_queue_send_pooled(TxQueue *q, TxLane lane, const char *uri, PoolBuffer *body, uint32_t body_len,
+                         uint16_t seq, TxDoneCallback done, void *user);
+
+void tx_queue_get_stats(TxQueue *q, TxLane lane, TxLaneStats *out);
+
+#endif // TX_QUEUE_H